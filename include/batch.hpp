@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <input.h>
+#include <parser.hpp>
+
+namespace Parser {
+
+/**
+ * Key fields of batch of packets stored in columns, one array per field.
+ * Only packets of the common shape are extracted, Ethernet with at most
+ * one 802.1Q tag carrying IPv4 with TCP or UDP. Other packets are not
+ * simple and have to be parsed one by one.
+ */
+struct Columns {
+  static constexpr std::size_t WIDTH = 16;
+
+  std::array<std::uint8_t, WIDTH> simple;
+  std::array<std::uint16_t, WIDTH> ethertype;
+  std::array<std::uint16_t, WIDTH> vlan;
+  /* Addresses are kept in network order */
+  std::array<std::uint32_t, WIDTH> src;
+  std::array<std::uint32_t, WIDTH> dst;
+  std::array<std::uint8_t, WIDTH> protocol;
+  std::array<std::uint16_t, WIDTH> sport;
+  std::array<std::uint16_t, WIDTH> dport;
+  /* Offsets of IP and transport headers and size of transport header */
+  std::array<std::uint8_t, WIDTH> network;
+  std::array<std::uint8_t, WIDTH> transport;
+  std::array<std::uint8_t, WIDTH> transport_size;
+  std::array<std::uint32_t, WIDTH> digest;
+};
+
+/**
+ * Digest of 5-tuple, addresses in network order and ports in host order.
+ * It is never zero and it is the same whether computed for a batch or
+ * for a single packet.
+ */
+std::uint32_t digest(std::uint32_t src, std::uint32_t dst,
+    std::uint8_t protocol, std::uint16_t sport, std::uint16_t dport);
+
+/**
+ * Extracts key fields of up to Columns::WIDTH packets into columns. AVX2
+ * is used if CPU supports it.
+ */
+void extract(const Packet* packets, std::size_t count, Columns& columns);
+
+/**
+ * Extracts key fields like extract(), without AVX2 and without clearing
+ * packets the fast path must parse, which extract() does afterwards.
+ */
+void extract_scalar(const Packet* packets, std::size_t count,
+    Columns& columns);
+
+/**
+ * Fills layers of simple packet from columns, as parse() would.
+ */
+void fill(const Columns& columns, std::size_t i, const std::uint8_t* data,
+    Layers& layers);
+
+} // namespace Parser
@@ -13,10 +13,16 @@ struct CacheEntry {
   Buffer values;
 };
 
-class Cache : public std::unordered_map<std::size_t, CacheEntry> {
+/**
+ * Flow cache indexed by flow hash. Flows with the same hash are told apart
+ * by their interface and values, which form the full flow key.
+ */
+class Cache : public std::unordered_multimap<std::size_t, CacheEntry> {
 public:
-  iterator insert_record(std::size_t, timeval, Buffer);
-  void update_record(iterator, timeval);
+  iterator find_record(std::size_t, std::uint32_t, const Buffer&);
+  iterator insert_record(std::size_t, timeval, std::uint32_t, std::size_t,
+      std::size_t, Buffer);
+  void update_record(iterator, timeval, std::size_t, std::size_t);
 };
 
 } // namespace Flow
@@ -17,6 +17,7 @@ class Exporter {
   Buffer _buffer;
   std::uint16_t _last_template = IPFIX::SET_USER_TEMPLATE + 1;
   std::uint32_t _sequence_num = 0;
+  bool _interfaces = false;
 
   void copy_template(std::uint16_t, Buffer);
 
@@ -28,6 +29,7 @@ public:
   std::uint16_t get_template_id(std::size_t) const;
 
   /* Modifiers */
+  void set_interfaces(bool);
   std::uint16_t insert_template(std::size_t, Buffer);
   void insert_record(const IPFIX::Properties&, std::uint8_t, Buffer);
   void flush();
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <pcap.h>
+
+#include <input.h>
+
+namespace Plugins {
+
+/**
+ * Capture filter applied in user space to packets of plugins, which can
+ * not apply capture options themselves. Filter expression is compiled for
+ * Ethernet, the only link type flower parses.
+ */
+class Filter {
+  bpf_program _program = {};
+  unsigned int _snaplen = 0;
+
+public:
+
+  /**
+   * Compiles filter expression.
+   * @param options capture options with filter and snaplen.
+   * @throws std::runtime_error if expression is invalid.
+   */
+  explicit Filter(const CaptureOptions& options);
+
+  ~Filter() noexcept;
+
+  Filter(const Filter&) = delete;
+  Filter& operator=(const Filter&) = delete;
+
+  /**
+   * Checks whether packet passes filter and truncates it to snaplen.
+   * Filter may be applied from multiple threads concurrently.
+   * @param packet packet to be checked.
+   * @return true if packet is to be processed.
+   */
+  bool apply(Packet& packet) const;
+};
+
+} // namespace Plugins
@@ -36,28 +36,6 @@ public:
     return ttou(IPFIX::Type::ETHERNET);
   }
 
-  std::size_t digest(const Tins::PDU& pdu) const override {
-    auto digest = std::size_t{type()};
-
-    const auto& ethernet = static_cast<const Tins::EthernetII&>(pdu);
-
-    if (_def.src) {
-      for (const auto& b : ethernet.src_addr()) {
-        digest = combine(digest, b);
-      }
-    }
-
-    if (_def.dst) {
-      for (const auto& b : ethernet.dst_addr()) {
-        digest = combine(digest, b);
-      }
-    }
-
-    digest = combine(digest, ethernet.payload_type());
-
-    return digest;
-  }
-
   Buffer fields() const override {
     auto fields = Buffer{};
 
@@ -77,9 +55,8 @@ public:
     return fields;
   }
 
-  Buffer values(const Tins::PDU& pdu) const override {
+  void values(const Tins::PDU& pdu, Buffer& values) const override {
     const auto& ethernet = static_cast<const Tins::EthernetII&>(pdu);
-    auto values = Buffer{};
     auto bkit = std::back_inserter(values);
 
     if (_def.src) {
@@ -93,8 +70,22 @@ public:
     }
 
     values.push_back_any<std::uint16_t>(htons(ethernet.payload_type()));
+  }
+
+  void values(const std::uint8_t* header, Buffer& values) const override {
+    auto bkit = std::back_inserter(values);
+
+    if (_def.src) {
+      std::copy_n(reinterpret_cast<const std::byte*>(header + 6),
+          IPFIX::TYPE_MAC, bkit);
+    }
+
+    if (_def.dst) {
+      std::copy_n(reinterpret_cast<const std::byte*>(header),
+          IPFIX::TYPE_MAC, bkit);
+    }
 
-    return values;
+    std::copy_n(reinterpret_cast<const std::byte*>(header + 12), 2, bkit);
   }
 };
 } // namespace Flow
@@ -10,9 +10,19 @@ class Flow {
 public:
   virtual bool should_process() const = 0;
   virtual std::size_t type() const = 0;
-  virtual std::size_t digest(const Tins::PDU& pdu) const = 0;
   virtual Buffer fields() const = 0;
-  virtual Buffer values(const Tins::PDU& pdu) const = 0;
+
+  /**
+   * Appends values of PDU to buffer. Values of all PDUs of packet form its
+   * flow key, so they must hold every field that tells flows apart.
+   */
+  virtual void values(const Tins::PDU& pdu, Buffer& values) const = 0;
+
+  /**
+   * Appends the same values read from raw header of layer found by fast
+   * path parser. Header holds the whole layer, as it was validated.
+   */
+  virtual void values(const std::uint8_t* header, Buffer& values) const = 0;
   virtual ~Flow() = default;
 };
 
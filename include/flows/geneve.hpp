@@ -0,0 +1,77 @@
+#pragma once
+
+#include <toml.hpp>
+
+#include <flows/flow.hpp>
+#include <ipfix.hpp>
+#include <common.hpp>
+
+#include <protocols/geneve.hpp>
+
+namespace Flow {
+
+class GENEVE : public Flow {
+  struct {
+    bool process;
+    bool vni;
+  } _def;
+
+public:
+
+  GENEVE(const toml::value& config) {
+    if (config.contains("geneve")) {
+      const auto& geneve = toml::find(config, "geneve");
+      _def.process = true;
+      _def.vni = toml::find_or(geneve, "vni", false);
+    } else {
+      _def.process = false;
+    }
+  }
+
+  bool should_process() const override {
+    return _def.process;
+  }
+
+  std::size_t type() const override {
+    return ttou(IPFIX::Type::GENEVE);
+  }
+
+  Buffer fields() const override {
+    auto fields = Buffer{};
+
+    if (_def.vni) {
+      fields.push_back_any<std::uint16_t>(htons(IPFIX::FIELD_LAYER2_SEGEMENT_ID));
+      fields.push_back_any<std::uint16_t>(htons(IPFIX::TYPE_64));
+    }
+
+    fields.push_back_any<std::uint16_t>(htons(IPFIX::FIELD_ETHERNET_TYPE));
+    fields.push_back_any<std::uint16_t>(htons(IPFIX::TYPE_16));
+
+    return fields;
+  }
+
+  void values(const Tins::PDU& pdu, Buffer& values) const override {
+    const auto& geneve = static_cast<const Protocols::GENEVEPDU&>(pdu);
+
+    /* Geneve VNI is 24 bits long as VXLAN VNI, so it is typed the same */
+    if (_def.vni) {
+      values.push_back_any<std::uint64_t>(
+          htonT((uint64_t{0x01} << 56) + geneve.vni()));
+    }
+
+    values.push_back_any<std::uint16_t>(htons(geneve.protocol()));
+  }
+
+  void values(const std::uint8_t* header, Buffer& values) const override {
+    const auto geneve = Protocols::GENEVEHeader{header};
+
+    if (_def.vni) {
+      values.push_back_any<std::uint64_t>(
+          htonT((uint64_t{0x01} << 56) + geneve.vni()));
+    }
+
+    values.push_back_any<std::uint16_t>(htons(geneve.protocol()));
+  }
+};
+
+} // namespace Flow
@@ -6,6 +6,8 @@
 #include <ipfix.hpp>
 #include <common.hpp>
 
+#include <protocols/gre.hpp>
+
 namespace Flow {
 
 class GRE : public Flow {
@@ -32,16 +34,6 @@ public:
     return ttou(IPFIX::Type::GRE);
   }
 
-  std::size_t digest(const Tins::PDU& pdu) const override {
-    auto digest = std::size_t{type()};
-
-    const auto& gre = static_cast<const Protocols::GREPDU&>(pdu);
-
-    digest = combine(digest, gre.protocol());
-
-    return digest;
-  }
-
   Buffer fields() const override {
     auto fields = Buffer{};
 
@@ -51,13 +43,16 @@ public:
     return fields;
   }
 
-  Buffer values(const Tins::PDU& pdu) const override {
+  void values(const Tins::PDU& pdu, Buffer& values) const override {
     const auto& gre = static_cast<const Protocols::GREPDU&>(pdu);
-    auto values = Buffer{};
 
     values.push_back_any<std::uint16_t>(htons(gre.protocol()));
+  }
 
-    return values;
+  void values(const std::uint8_t* header, Buffer& values) const override {
+    const auto gre = Protocols::GREHeader{header};
+
+    values.push_back_any<std::uint16_t>(htons(gre.protocol()));
   }
 };
 
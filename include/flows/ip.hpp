@@ -36,22 +36,6 @@ public:
     return ttou(IPFIX::Type::IP);
   }
 
-  std::size_t digest(const Tins::PDU& pdu) const override {
-    auto digest = std::size_t{type()};
-
-    const auto& ip = static_cast<const Tins::IP&>(pdu);
-
-    if (_def.src)
-      digest = combine(digest, ip.src_addr());
-
-    if (_def.dst)
-      digest = combine(digest, ip.dst_addr());
-
-    digest = combine(digest, ip.protocol());
-
-    return digest;
-  }
-
   Buffer fields() const override {
     auto fields = Buffer{};
 
@@ -74,9 +58,8 @@ public:
     return fields;
   }
 
-  Buffer values(const Tins::PDU& pdu) const override {
+  void values(const Tins::PDU& pdu, Buffer& values) const override {
     const auto& ip = static_cast<const Tins::IP&>(pdu);
-    auto values = Buffer{};
 
     if (_def.src) {
       values.push_back_any<std::uint32_t>(ip.src_addr());
@@ -88,8 +71,23 @@ public:
 
     values.push_back_any<std::uint8_t>(ip.version());
     values.push_back_any<std::uint8_t>(ip.protocol());
+  }
+
+  void values(const std::uint8_t* header, Buffer& values) const override {
+    auto bkit = std::back_inserter(values);
+
+    if (_def.src) {
+      std::copy_n(reinterpret_cast<const std::byte*>(header + 12),
+          IPFIX::TYPE_IPV4, bkit);
+    }
+
+    if (_def.dst) {
+      std::copy_n(reinterpret_cast<const std::byte*>(header + 16),
+          IPFIX::TYPE_IPV4, bkit);
+    }
 
-    return values;
+    values.push_back_any<std::uint8_t>(header[0] >> 4);
+    values.push_back_any<std::uint8_t>(header[9]);
   }
 };
 
@@ -36,28 +36,6 @@ public:
     return ttou(IPFIX::Type::IPV6);
   }
 
-  std::size_t digest(const Tins::PDU& pdu) const override {
-    auto digest = std::size_t{type()};
-
-    const auto& ipv6 = static_cast<const Tins::IPv6&>(pdu);
-
-    if (_def.src) {
-      for (const auto& b : ipv6.src_addr()) {
-        digest = combine(digest, b);
-      }
-    }
-
-    if (_def.dst) {
-      for (const auto& b : ipv6.dst_addr()) {
-        digest = combine(digest, b);
-      }
-    }
-
-    digest = combine(digest, ipv6.next_header());
-
-    return digest;
-  }
-
   Buffer fields() const override {
     auto fields = Buffer{};
 
@@ -80,9 +58,8 @@ public:
     return fields;
   }
 
-  Buffer values(const Tins::PDU& pdu) const override {
+  void values(const Tins::PDU& pdu, Buffer& values) const override {
     const auto& ipv6 = static_cast<const Tins::IPv6&>(pdu);
-    auto values = Buffer{};
     auto bkit = std::back_inserter(values);
 
     if (_def.src) {
@@ -97,8 +74,23 @@ public:
 
     values.push_back_any<std::uint8_t>(ipv6.version());
     values.push_back_any<std::uint8_t>(ipv6.next_header());
+  }
+
+  void values(const std::uint8_t* header, Buffer& values) const override {
+    auto bkit = std::back_inserter(values);
+
+    if (_def.src) {
+      std::copy_n(reinterpret_cast<const std::byte*>(header + 8),
+          IPFIX::TYPE_IPV6, bkit);
+    }
+
+    if (_def.dst) {
+      std::copy_n(reinterpret_cast<const std::byte*>(header + 24),
+          IPFIX::TYPE_IPV6, bkit);
+    }
 
-    return values;
+    values.push_back_any<std::uint8_t>(header[0] >> 4);
+    values.push_back_any<std::uint8_t>(header[6]);
   }
 };
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstring>
+
 #include <toml.hpp>
 
 #include <flows/flow.hpp>
@@ -32,16 +34,6 @@ public:
     return ttou(IPFIX::Type::MPLS);
   }
 
-  std::size_t digest(const Tins::PDU& pdu) const override {
-    auto digest = std::size_t{type()};
-
-    const auto& mpls = static_cast<const Tins::MPLS&>(pdu);
-
-    digest = combine(digest, mpls.label());
-
-    return digest;
-  }
-
   Buffer fields() const override {
     auto fields = Buffer{};
 
@@ -52,13 +44,17 @@ public:
     return fields;
   }
 
-  Buffer values(const Tins::PDU& pdu) const override {
+  void values(const Tins::PDU& pdu, Buffer& values) const override {
     const auto& mpls = static_cast<const Tins::MPLS&>(pdu);
-    auto values = Buffer{};
 
     values.push_back_any<std::uint32_t>(htonl(mpls.label()));
+  }
+
+  void values(const std::uint8_t* header, Buffer& values) const override {
+    std::uint32_t entry;
+    std::memcpy(&entry, header, sizeof(entry));
 
-    return values;
+    values.push_back_any<std::uint32_t>(htonl(ntohl(entry) >> 12));
   }
 };
 
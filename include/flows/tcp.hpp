@@ -36,20 +36,6 @@ public:
     return ttou(IPFIX::Type::TCP);
   }
 
-  std::size_t digest(const Tins::PDU& pdu) const override {
-    auto digest = std::size_t{type()};
-
-    const auto& tcp = static_cast<const Tins::TCP&>(pdu);
-
-    if (_def.src)
-      digest = combine(digest, tcp.sport());
-
-    if (_def.dst)
-      digest = combine(digest, tcp.dport());
-
-    return digest;
-  }
-
   Buffer fields() const override {
     auto fields = Buffer{};
 
@@ -66,9 +52,8 @@ public:
     return fields;
   }
 
-  Buffer values(const Tins::PDU& pdu) const override {
+  void values(const Tins::PDU& pdu, Buffer& values) const override {
     const auto& tcp = static_cast<const Tins::TCP&>(pdu);
-    auto values = Buffer{};
 
     if (_def.src) {
       values.push_back_any<std::uint16_t>(htons(tcp.sport()));
@@ -77,8 +62,18 @@ public:
     if (_def.dst) {
       values.push_back_any<std::uint16_t>(htons(tcp.dport()));
     }
+  }
+
+  void values(const std::uint8_t* header, Buffer& values) const override {
+    auto bkit = std::back_inserter(values);
 
-    return values;
+    if (_def.src) {
+      std::copy_n(reinterpret_cast<const std::byte*>(header), 2, bkit);
+    }
+
+    if (_def.dst) {
+      std::copy_n(reinterpret_cast<const std::byte*>(header + 2), 2, bkit);
+    }
   }
 };
 
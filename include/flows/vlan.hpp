@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstring>
+
 #include <toml.hpp>
 
 #include <flows/flow.hpp>
@@ -34,17 +36,6 @@ public:
     return ttou(IPFIX::Type::DOT1Q);
   }
 
-  std::size_t digest(const Tins::PDU& pdu) const override {
-    auto digest = std::size_t{type()};
-
-    const auto& vlan = static_cast<const Tins::Dot1Q&>(pdu);
-
-    if (_def.id)
-      digest = combine(digest, vlan.id());
-
-    return digest;
-  }
-
   Buffer fields() const override {
     auto fields = Buffer{};
 
@@ -56,15 +47,20 @@ public:
     return fields;
   }
 
-  Buffer values(const Tins::PDU& pdu) const override {
+  void values(const Tins::PDU& pdu, Buffer& values) const override {
     const auto& dot1q = static_cast<const Tins::Dot1Q&>(pdu);
-    auto values = Buffer{};
 
     if (_def.id) {
       values.push_back_any<std::uint16_t>(htons(dot1q.id()));
     }
+  }
 
-    return values;
+  void values(const std::uint8_t* header, Buffer& values) const override {
+    if (_def.id) {
+      std::uint16_t tci;
+      std::memcpy(&tci, header, sizeof(tci));
+      values.push_back_any<std::uint16_t>(tci & htons(0x0fff));
+    }
   }
 };
 
@@ -36,17 +36,6 @@ public:
     return ttou(IPFIX::Type::VXLAN);
   }
 
-  std::size_t digest(const Tins::PDU& pdu) const override {
-    auto digest = std::size_t{type()};
-
-    const auto& vxlan = static_cast<const Protocols::VXLANPDU&>(pdu);
-
-    if (_def.vni)
-      digest = combine(digest, vxlan.vni());
-
-    return digest;
-  }
-
   Buffer fields() const override {
     auto fields = Buffer{};
 
@@ -58,16 +47,22 @@ public:
     return fields;
   }
 
-  Buffer values(const Tins::PDU& pdu) const override {
+  void values(const Tins::PDU& pdu, Buffer& values) const override {
     const auto& vxlan = static_cast<const Protocols::VXLANPDU&>(pdu);
-    auto values = Buffer{};
 
     if (_def.vni) {
       values.push_back_any<std::uint64_t>(
           htonT((uint64_t{0x01} << 56) + vxlan.vni()));
     }
+  }
+
+  void values(const std::uint8_t* header, Buffer& values) const override {
+    const auto vxlan = Protocols::VXLANHeader{header};
 
-    return values;
+    if (_def.vni) {
+      values.push_back_any<std::uint64_t>(
+          htonT((uint64_t{0x01} << 56) + vxlan.vni()));
+    }
   }
 };
 
@@ -32,6 +32,25 @@ struct Packet {
    * Timestamp nanoseconds of packet capture.
    */
   unsigned int usec;
+
+  /**
+   * Index of interface the packet was captured on, used by inputs
+   * providing packets of multiple links. Zero if not applicable.
+   */
+  unsigned int interface;
+
+  /**
+   * Flow hash computed by NIC, e.g. RSS hash, zero if not provided. Flower
+   * uses it only if plugin declares it by function tuple_hash().
+   */
+  unsigned int hash;
+
+  /**
+   * Payload size of one segment if the packet was coalesced from several
+   * segments by GRO or LRO, zero otherwise. Flower then accounts every
+   * segment as a separate packet with its own headers.
+   */
+  unsigned int segment_size;
 };
 
 enum ResultType {
@@ -56,6 +75,119 @@ struct GetPacketResult {
   struct Packet packet;
 };
 
+/**
+ * Result of batched packet capture. Plugins may optionally provide function
+ * get_packets(struct Packet* out, unsigned int max) that fills up to max
+ * packets at once. Type is CAPTURE_PACKET whenever count is not zero.
+ * Packets must be valid until next get_packets or get_packet is called.
+ */
+struct GetPacketsResult {
+  enum GetPacketResultType type;
+  unsigned int count;
+};
+
+/**
+ * Packet leased from plugin. Plugins may optionally provide function
+ * lease_packets(struct LeasedPacket* out, unsigned int max) with the same
+ * semantics as get_packets, except that leased packet data stay valid until
+ * the packet is given back by release_packets(void* const* handles,
+ * unsigned int n). Function release_packets may be called from a different
+ * thread than the one capturing packets.
+ */
+struct LeasedPacket {
+  /**
+   * Leased packet. Data are valid until the packet is released.
+   */
+  struct Packet packet;
+
+  /**
+   * Opaque handle identifying the lease, must not be NULL.
+   */
+  void* handle;
+};
+
+/**
+ * Structure with input counters. Plugins may optionally provide
+ * function statistics returning this structure.
+ */
+struct Statistics {
+  /**
+   * Number of packets seen by the input, including dropped ones.
+   */
+  unsigned long long packets;
+
+  /**
+   * Number of packets dropped before reaching the plugin, e.g. by kernel.
+   */
+  unsigned long long drops;
+};
+
+/**
+ * Plugins providing packets of multiple interfaces may optionally provide
+ * function interfaces() returning non-zero. Index of interface of packets
+ * is then exported as ingressInterface, otherwise it is left out.
+ */
+typedef int InterfacesRT;
+
+/**
+ * Plugins filling hash of packets may optionally provide function
+ * tuple_hash() returning non-zero if the hash is computed only from
+ * addresses, protocol and TCP or UDP ports of the outermost IP header, such
+ * as Toeplitz RSS hash. Flower then places flows in its cache by this hash
+ * instead of hashing their key. Hashes also covering other fields, e.g.
+ * IPv6 flow label or headers inside tunnels, must not be declared, as
+ * packets of one flow would get different hashes.
+ */
+typedef int TupleHashRT;
+
+/**
+ * Plugins may optionally provide function last_error() returning description
+ * of the error that made capture end with CAPTURE_INPUT_ERROR. The string
+ * must stay valid until the plugin is finalized.
+ */
+typedef const char* LastErrorRT;
+
+/**
+ * Plugins may optionally split input into multiple queues, e.g. fanout
+ * sockets, hardware receive queues or separate files, each processed by
+ * its own thread. Function queue_count() returns the number of queues and
+ * is called after init. Queue functions get_packet_q(unsigned int queue),
+ * get_packets_q(unsigned int queue, struct Packet* out, unsigned int max)
+ * and lease_packets_q(unsigned int queue, struct LeasedPacket* out,
+ * unsigned int max) have the same semantics as their single queue
+ * counterparts, except that different queues are read by different
+ * threads concurrently. One queue is never read by two threads at once,
+ * so the queue id serves as a handle of per queue state kept by plugin.
+ * Plugin providing queues must provide get_packet_q or get_packets_q.
+ */
+typedef unsigned int QueueCountRT;
+
+/**
+ * Capture options set in configuration file. Plugins may optionally provide
+ * function configure(const struct CaptureOptions* options), which is called
+ * before init, so the options can be applied when the capture is opened.
+ * Capturing plugins should apply them as early as possible, e.g. by kernel
+ * socket filter. Options of plugin without configure function are applied
+ * by flower in user space once packets are captured.
+ */
+struct CaptureOptions {
+  /**
+   * Filter expression in pcap-filter syntax, empty string if not set.
+   * Only packets matching the filter are returned.
+   */
+  const char* filter;
+
+  /**
+   * Maximal number of bytes captured of every packet, zero if not set.
+   */
+  unsigned int snaplen;
+};
+
+typedef struct InitResult ConfigureRT;
+
 typedef struct GetPacketResult GetPacketRT;
+typedef struct GetPacketsResult GetPacketsRT;
+typedef struct Statistics StatisticsRT;
+typedef void ReleasePacketsRT;
 typedef struct InitResult InitRT;
 typedef void FinalizeRT;
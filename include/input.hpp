@@ -1,5 +1,10 @@
 #pragma once
 
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <filter.hpp>
 #include <input.h>
 #include <plugin.hpp>
 
@@ -9,41 +14,169 @@ namespace Plugins {
  * Class providing input data to flow processing
  */
 class Input {
+  static constexpr auto CONFIGURE_FUNCTION = "configure";
   static constexpr auto INIT_FUNCTION = "init";
   static constexpr auto FINALIZE_FUNCTION = "finalize";
   static constexpr auto GET_PACKET_FUNCTION = "get_packet";
+  static constexpr auto GET_PACKETS_FUNCTION = "get_packets";
+  static constexpr auto LEASE_PACKETS_FUNCTION = "lease_packets";
+  static constexpr auto RELEASE_PACKETS_FUNCTION = "release_packets";
+  static constexpr auto STATISTICS_FUNCTION = "statistics";
+  static constexpr auto LAST_ERROR_FUNCTION = "last_error";
+  static constexpr auto INTERFACES_FUNCTION = "interfaces";
+  static constexpr auto TUPLE_HASH_FUNCTION = "tuple_hash";
+  static constexpr auto QUEUE_COUNT_FUNCTION = "queue_count";
+  static constexpr auto GET_PACKET_Q_FUNCTION = "get_packet_q";
+  static constexpr auto GET_PACKETS_Q_FUNCTION = "get_packets_q";
+  static constexpr auto LEASE_PACKETS_Q_FUNCTION = "lease_packets_q";
 
+  using ConfigureFun = ConfigureRT(const CaptureOptions*);
   using InitFun = InitRT(const char*);
   using FinalizeFun = FinalizeRT();
   using GetPacketFun = GetPacketRT();
+  using GetPacketsFun = GetPacketsRT(Packet*, unsigned int);
+  using LeasePacketsFun = GetPacketsRT(LeasedPacket*, unsigned int);
+  using ReleasePacketsFun = ReleasePacketsRT(void* const*, unsigned int);
+  using StatisticsFun = StatisticsRT();
+  using LastErrorFun = LastErrorRT();
+  using InterfacesFun = InterfacesRT();
+  using TupleHashFun = TupleHashRT();
+  using QueueCountFun = QueueCountRT();
+  using GetPacketQFun = GetPacketRT(unsigned int);
+  using GetPacketsQFun = GetPacketsRT(unsigned int, Packet*, unsigned int);
+  using LeasePacketsQFun = GetPacketsRT(unsigned int, LeasedPacket*, unsigned int);
 
   Plugin _plugin;
 
   InitFun* _init = nullptr;
   FinalizeFun* _finalize = nullptr;
   GetPacketFun* _get_packet = nullptr;
+  GetPacketsFun* _get_packets = nullptr;
+  LeasePacketsFun* _lease_packets = nullptr;
+  ReleasePacketsFun* _release_packets = nullptr;
+  StatisticsFun* _statistics = nullptr;
+  LastErrorFun* _last_error = nullptr;
+  InterfacesFun* _interfaces = nullptr;
+  TupleHashFun* _tuple_hash = nullptr;
+  QueueCountFun* _queue_count = nullptr;
+  GetPacketQFun* _get_packet_q = nullptr;
+  GetPacketsQFun* _get_packets_q = nullptr;
+  LeasePacketsQFun* _lease_packets_q = nullptr;
+
+  unsigned int _queues = 1;
+
+  /* Capture options of plugin without configure are applied here */
+  std::unique_ptr<Filter> _filter;
+
+  /**
+   * Removes packets not passing filter from batch, keeping their order.
+   * @return Result with number of packets left, timeout if none is left.
+   */
+  template<typename T, typename Drop>
+  GetPacketsRT filter(GetPacketsRT result, T* packets, Drop drop) const {
+    if (_filter == nullptr || result.type != CAPTURE_PACKET)
+      return result;
+
+    auto count = 0u;
+    for (auto i = 0u; i < result.count; ++i) {
+      if (_filter->apply(packet_of(packets[i])))
+        packets[count++] = packets[i];
+      else
+        drop(packets[i]);
+    }
+
+    return {count ? CAPTURE_PACKET : CAPTURE_TIMEOUT, count};
+  }
+
+  static Packet& packet_of(Packet& packet) {
+    return packet;
+  }
+
+  static Packet& packet_of(LeasedPacket& leased) {
+    return leased.packet;
+  }
+
+  /**
+   * Gets batch of packets using the best function plugin provides.
+   */
+  GetPacketsRT capture_packets(unsigned int queue, Packet* out,
+      unsigned int max) {
+    GetPacketRT result;
+
+    if (_get_packets_q != nullptr)
+      return _get_packets_q(queue, out, max);
+
+    if (_get_packet_q != nullptr) {
+      result = _get_packet_q(queue);
+    } else if (_get_packets != nullptr) {
+      return _get_packets(out, max);
+    } else {
+      result = _get_packet();
+    }
+
+    if (result.type != CAPTURE_PACKET)
+      return {result.type, 0};
+
+    out[0] = result.packet;
+    return {CAPTURE_PACKET, 1};
+  }
 
 public:
 
   /**
    * Constructor of input class. It takes plugin and loads it
-   * as input plugin. This class initializes plugin on construction.
+   * as input plugin. This class configures and initializes plugin on
+   * construction.
    * @param plugin plugin to be used as input.
    * @param arg argument for plugin initialization.
+   * @param capture capture options, applied in user space if plugin does not
+   * support them.
    */
-  Input(Plugin&& plugin, const char* arg):
+  Input(Plugin&& plugin, const char* arg,
+      const CaptureOptions& capture = CaptureOptions{"", 0}):
     _plugin(std::move(plugin)),
     _init(_plugin.function<InitFun>(INIT_FUNCTION)),
     _finalize(_plugin.function<FinalizeFun>(FINALIZE_FUNCTION)),
-    _get_packet(_plugin.function<GetPacketFun>(GET_PACKET_FUNCTION)) {
+    _get_packet(_plugin.function<GetPacketFun>(GET_PACKET_FUNCTION)),
+    _get_packets(_plugin.optional_function<GetPacketsFun>(GET_PACKETS_FUNCTION)),
+    _lease_packets(_plugin.optional_function<LeasePacketsFun>(LEASE_PACKETS_FUNCTION)),
+    _release_packets(_plugin.optional_function<ReleasePacketsFun>(RELEASE_PACKETS_FUNCTION)),
+    _statistics(_plugin.optional_function<StatisticsFun>(STATISTICS_FUNCTION)),
+    _last_error(_plugin.optional_function<LastErrorFun>(LAST_ERROR_FUNCTION)),
+    _interfaces(_plugin.optional_function<InterfacesFun>(INTERFACES_FUNCTION)),
+    _tuple_hash(_plugin.optional_function<TupleHashFun>(TUPLE_HASH_FUNCTION)),
+    _queue_count(_plugin.optional_function<QueueCountFun>(QUEUE_COUNT_FUNCTION)),
+    _get_packet_q(_plugin.optional_function<GetPacketQFun>(GET_PACKET_Q_FUNCTION)),
+    _get_packets_q(_plugin.optional_function<GetPacketsQFun>(GET_PACKETS_Q_FUNCTION)),
+    _lease_packets_q(_plugin.optional_function<LeasePacketsQFun>(LEASE_PACKETS_Q_FUNCTION)) {
+      auto configure = _plugin.optional_function<ConfigureFun>(CONFIGURE_FUNCTION);
+
+      if (configure != nullptr) {
+        auto result = configure(&capture);
+        if (result.type == RESULT_ERROR) {
+          throw std::runtime_error{result.error_msg};
+        }
+      } else if (*capture.filter != '\0' || capture.snaplen != 0) {
+        _filter = std::make_unique<Filter>(capture);
+      }
+
       auto result = _init(arg);
       if (result.type == RESULT_ERROR) {
         throw std::runtime_error{result.error_msg};
       }
+
+      if (_queue_count != nullptr)
+        _queues = _queue_count();
+
+      if (_queues == 0 || (_queues > 1 && _get_packet_q == nullptr
+            && _get_packets_q == nullptr)) {
+        throw std::runtime_error{"Input provides queues without queue functions"};
+      }
     }
 
-  Input(const std::string& file, const char* arg):
-    Input(Plugin{file}, arg) {}
+  Input(const std::string& file, const char* arg,
+      const CaptureOptions& capture = CaptureOptions{"", 0}):
+    Input(Plugin{file}, arg, capture) {}
 
   // Copy
   Input(const Input&) = delete;
@@ -59,6 +192,19 @@ public:
     std::swap(_init, other._init);
     std::swap(_finalize, other._finalize);
     std::swap(_get_packet, other._get_packet);
+    std::swap(_get_packets, other._get_packets);
+    std::swap(_lease_packets, other._lease_packets);
+    std::swap(_release_packets, other._release_packets);
+    std::swap(_statistics, other._statistics);
+    std::swap(_last_error, other._last_error);
+    std::swap(_interfaces, other._interfaces);
+    std::swap(_tuple_hash, other._tuple_hash);
+    std::swap(_queue_count, other._queue_count);
+    std::swap(_get_packet_q, other._get_packet_q);
+    std::swap(_get_packets_q, other._get_packets_q);
+    std::swap(_lease_packets_q, other._lease_packets_q);
+    std::swap(_queues, other._queues);
+    std::swap(_filter, other._filter);
 
     return *this;
   }
@@ -76,7 +222,131 @@ public:
    * @return Packet packet provided by plugin, if empty packet.data is equal to nullptr
    */
   GetPacketRT get_packet() {
-    return _get_packet();
+    auto result = _get_packet();
+
+    while (_filter != nullptr && result.type == CAPTURE_PACKET
+        && !_filter->apply(result.packet))
+      result = _get_packet();
+
+    return result;
+  }
+
+  /**
+   * Gets number of queues provided by plugin. Every queue may be read
+   * by a different thread.
+   * @return Number of queues, one if plugin does not provide queues.
+   */
+  [[nodiscard]] unsigned int queue_count() const {
+    return _queues;
+  }
+
+  /**
+   * Gets batch of packets from queue of plugin. Packets must be valid until
+   * next get_packets or get_packet is called on the same queue. If plugin
+   * does not provide batched capture, single packet is captured. Different
+   * queues may be read concurrently, one queue is not thread safe.
+   * @param queue id of queue, lower than queue_count().
+   * @param out array to be filled with packets.
+   * @param max capacity of out array, must not be zero.
+   * @return Result type and number of packets filled.
+   */
+  GetPacketsRT get_packets(unsigned int queue, Packet* out, unsigned int max) {
+    return filter(capture_packets(queue, out, max), out, [](const Packet&) {});
+  }
+
+  /**
+   * Checks whether plugin is able to lease packets of all its queues.
+   * @return true if release_packets and lease function are provided.
+   */
+  [[nodiscard]] bool leases() const {
+    if (_release_packets == nullptr)
+      return false;
+
+    return _queues > 1
+      ? _lease_packets_q != nullptr
+      : _lease_packets_q != nullptr || _lease_packets != nullptr;
+  }
+
+  /**
+   * Leases batch of packets from queue of plugin. Leased packets stay valid
+   * until they are released, so they can be passed to other threads. Must be
+   * called only if leases() is true. Different queues may be read
+   * concurrently, one queue is not thread safe.
+   * @param queue id of queue, lower than queue_count().
+   * @param out array to be filled with leased packets.
+   * @param max capacity of out array, must not be zero.
+   * @return Result type and number of packets leased.
+   */
+  GetPacketsRT lease_packets(unsigned int queue, LeasedPacket* out,
+      unsigned int max) {
+    auto result = _lease_packets_q != nullptr
+      ? _lease_packets_q(queue, out, max)
+      : _lease_packets(out, max);
+
+    if (_filter == nullptr)
+      return result;
+
+    /* Packets not passing filter are given back right away */
+    auto dropped = std::vector<void*>{};
+    result = filter(result, out, [&](const LeasedPacket& leased) {
+        dropped.push_back(leased.handle);
+    });
+
+    if (!dropped.empty())
+      release_packets(dropped.data(), dropped.size());
+
+    return result;
+  }
+
+  /**
+   * Gives leased packets back to plugin. May be called from a different
+   * thread than lease_packets and concurrently for different queues.
+   * @param handles handles of leased packets.
+   * @param n number of handles.
+   */
+  void release_packets(void* const* handles, unsigned int n) {
+    _release_packets(handles, n);
+  }
+
+  /**
+   * Gets input counters from plugin. Providing statistics is optional
+   * for plugins.
+   * @return Statistics if plugin provides them, empty otherwise.
+   */
+  std::optional<StatisticsRT> statistics() const {
+    if (_statistics == nullptr)
+      return std::nullopt;
+
+    return _statistics();
+  }
+
+  /**
+   * Checks whether packets of plugin carry index of their interface.
+   * @return true if plugin reports interfaces.
+   */
+  [[nodiscard]] bool interfaces() const {
+    return _interfaces != nullptr && _interfaces() != 0;
+  }
+
+  /**
+   * Checks whether hash of packets depends only on their 5-tuple.
+   * @return true if plugin declares its hash as 5-tuple hash.
+   */
+  [[nodiscard]] bool tuple_hash() const {
+    return _tuple_hash != nullptr && _tuple_hash() != 0;
+  }
+
+  /**
+   * Gets description of error which ended capture. Providing it is optional
+   * for plugins.
+   * @return Description of error, generic message if plugin does not
+   * provide it.
+   */
+  const char* last_error() const {
+    if (_last_error == nullptr)
+      return "Input error";
+
+    return _last_error();
   }
 };
 
@@ -30,9 +30,11 @@ static constexpr std::uint8_t SEMANTIC_ORDERED = 0x04;
 
 /* Template/Record fields */
 /* https://www.iana.org/assignments/ipfix/ipfix.xhtml */
+static constexpr std::uint16_t FIELD_OCTET_DELTA_COUNT = 1;
 static constexpr std::uint16_t FIELD_PACKET_DELTA_COUNT = 2;
 static constexpr std::uint16_t FIELD_PROTOCOL_IDENTIFIER = 4;
 static constexpr std::uint16_t FIELD_SRC_IP4_ADDR = 8;
+static constexpr std::uint16_t FIELD_INGRESS_INTERFACE = 10;
 static constexpr std::uint16_t FIELD_DST_IP4_ADDR = 12;
 static constexpr std::uint16_t FIELD_SRC_IP6_ADDR = 27;
 static constexpr std::uint16_t FIELD_DST_IP6_ADDR = 28;
@@ -53,6 +55,7 @@ static constexpr std::uint16_t FIELD_ETHERNET_TYPE = 256;
 static constexpr std::uint16_t FIELD_SUB_TEMPLATE_MULTI_LIST = 293;
 static constexpr std::uint16_t FIELD_MPLS_LABEL_STACK_SECTION = 316;
 static constexpr std::uint16_t FIELD_LAYER2_SEGEMENT_ID = 351;
+static constexpr std::uint16_t FIELD_LAYER2_OCTET_DELTA_COUNT = 352;
 
 /* Protocol identifiers */
 /* https://www.iana.org/assignments/protocol-numbers/protocol-numbers.xhtml */
@@ -76,13 +79,16 @@ enum class Type {
   MPLS = PROTOCOL_MPLS,
   VXLAN,
   GRE = PROTOCOL_GRE,
-  ETHERNET
+  ETHERNET,
+  GENEVE
 };
 
 struct Properties {
   std::size_t count;
+  std::size_t octets;
   timeval flow_start;
   timeval flow_end;
+  std::uint32_t interface;
 };
 
 /* Cast from Type to uint8_t */
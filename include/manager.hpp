@@ -5,7 +5,7 @@
 namespace Plugins {
 
 void load_plugins(const std::string&);
-Input create_input(const std::string&, const char*);
+Input create_input(const std::string&, const char*, const CaptureOptions&);
 void print_plugins();
 
 } // namespace Plugins
@@ -31,6 +31,8 @@ struct Options {
   std::uint32_t idle_timeout;
   std::string ip_address;
   std::uint16_t port;
+  std::string filter;
+  std::uint32_t snaplen;
 };
 
 /* Modifiers */
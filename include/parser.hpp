@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <functional>
 #include <memory>
 
 #include <tins/tins.h>
@@ -13,7 +15,8 @@ namespace Parser {
 
 using ParserFun = Tins::PDU* (*)(const std::uint8_t*, std::uint32_t);
 
-void insert_udp_parser(std::uint16_t port, ParserFun f);
+void insert_udp_parser(std::uint16_t port, Tins::PDU::PDUType type,
+    ParserFun f);
 
 template<typename T>
 Tins::PDU*
@@ -26,7 +29,7 @@ template<typename T>
 void
 register_udp_parser(std::uint16_t port)
 {
-  insert_udp_parser(port, &default_parser<T>);
+  insert_udp_parser(port, T::pdu_flag, &default_parser<T>);
 }
 
 template<typename T, typename U>
@@ -36,9 +39,131 @@ register_tins_parser(std::size_t id)
   Tins::Allocators::register_allocator<T, U>(id);
 }
 
+/**
+ * Limits parsing to layers that are needed, such as layers with reducer.
+ * Parsing stops as soon as no deeper layer can be needed and tunnels are
+ * entered only if they are needed themselves. Until called, whole packets
+ * are parsed.
+ */
+void require_layers(const std::function<bool(Tins::PDU::PDUType)>&);
+
+/**
+ * Checks whether layers below layer of given type are parsed.
+ */
+bool descends(Tins::PDU::PDUType);
+
+/**
+ * Checks whether UDP payload sent to given port is parsed.
+ */
+bool parses_udp_payload(std::uint16_t port);
+
 /**
  * Parse raw packet buffer into Tins::PDU.
  */
 std::unique_ptr<Tins::PDU> parse(const std::uint8_t*, std::uint32_t);
 
+/**
+ * Header of packet found by fast path parser. Its type is the type of PDU
+ * libtins would create for it, so reducers are looked up the same way.
+ */
+struct Layer {
+  Tins::PDU::PDUType type;
+  std::uint16_t offset;
+  std::uint16_t size;
+};
+
+/**
+ * Layers of packet found without allocating PDUs. Headers are copied from
+ * packet data, so layers stay valid after input reuses its buffers.
+ */
+struct Layers {
+  static constexpr std::size_t MAX_LAYERS = 16;
+  static constexpr std::size_t MAX_HEADERS = 256;
+
+  std::uint8_t count = 0;
+  std::array<Layer, MAX_LAYERS> layers;
+  std::array<std::uint8_t, MAX_HEADERS> headers;
+
+  const std::uint8_t* header(const Layer& layer) const {
+    return headers.data() + layer.offset;
+  }
+};
+
+/**
+ * Result of fast path parser. Packet with unknown ethertype is parsed up to
+ * the header announcing it, packet with unsupported headers has to be
+ * parsed into Tins::PDU and other packets are malformed.
+ */
+enum class Error : std::uint8_t {
+  NONE,
+  UNKNOWN_ETHERTYPE,
+  UNSUPPORTED,
+  TRUNCATED,
+  BAD_VERSION,
+  BAD_IHL,
+  BAD_TCP_OFFSET,
+  BAD_TUNNEL,
+  /* Rejected by libtins after fast path found it unsupported */
+  MALFORMED,
+  ERROR_COUNT
+};
+
+/**
+ * Checks whether layers were found despite the error.
+ */
+inline bool
+parsed(Error error)
+{
+  return error == Error::NONE || error == Error::UNKNOWN_ETHERTYPE;
+}
+
+/**
+ * Validates IPv4 header, the same way for single packets and batches.
+ * @param length set to header length if header is valid.
+ * @return Error::NONE or reason to drop packet.
+ */
+inline Error
+ipv4_header(const std::uint8_t* header, std::uint32_t available,
+    std::uint32_t& length)
+{
+  if (available < 20)
+    return Error::TRUNCATED;
+  if (header[0] >> 4 != 4)
+    return Error::BAD_VERSION;
+  length = (header[0] & 0x0f) * 4;
+  if (length < 20)
+    return Error::BAD_IHL;
+  if (available < length)
+    return Error::TRUNCATED;
+  return Error::NONE;
+}
+
+/**
+ * Validates TCP header, the same way for single packets and batches.
+ * @param length set to header length if header is valid.
+ * @return Error::NONE or reason to drop packet.
+ */
+inline Error
+tcp_header(const std::uint8_t* header, std::uint32_t available,
+    std::uint32_t& length)
+{
+  if (available < 20)
+    return Error::TRUNCATED;
+  length = (header[12] >> 4) * 4;
+  if (length < 20)
+    return Error::BAD_TCP_OFFSET;
+  if (available < length)
+    return Error::TRUNCATED;
+  return Error::NONE;
+}
+
+const char* error_name(Error);
+
+/**
+ * Finds layers of raw packet buffer (Ethernet, 802.1Q, MPLS, IPv4, IPv6,
+ * TCP, UDP, GRE, VXLAN, Geneve and GTP-U) without any allocation. Headers
+ * are validated, so nothing is thrown.
+ */
+Error parse(const std::uint8_t*, std::uint32_t, Layers&) noexcept;
+
 } // namespace Parser
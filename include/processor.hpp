@@ -1,29 +1,41 @@
 #pragma once
 
+#include <array>
 #include <chrono>
 
 #include <cache.hpp>
 #include <exporter.hpp>
-
-namespace Tins {
-  class PDU;
-} // namespace Tins
+#include <input.hpp>
+#include <parser.hpp>
 
 namespace Flow {
 
+class Flow;
+
 class Processor {
 
   Cache _cache;
   Exporter _exporter;
+  Buffer _key;
+  std::array<std::uint16_t, 256> _template_ids{};
   Cache::iterator _peek_iterator;
   std::chrono::time_point<std::chrono::high_resolution_clock> _time_point;
 
   std::uint32_t _active_timeout;
   std::uint32_t _idle_timeout;
 
-  void process(Tins::PDU*, timeval);
+  /* Input declares its packet hash as 5-tuple hash */
+  bool _tuple_hash = false;
+
+  std::uint16_t template_id(const Flow&);
+  template<typename T>
+  void append_values(Tins::PDU::PDUType, const T&);
+  void process(Tins::PDU*, const Packet&);
+  void process(const Parser::Layers&, const Packet&, std::uint32_t = 0);
+  void account(const Packet&, std::size_t, std::uint32_t);
   void check_idle_timeout(std::uint32_t, std::size_t);
   void check_active_timeout(std::uint32_t, CacheEntry&);
+  void run(Plugins::Input&, unsigned int);
 
 public:
 
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <array>
+#include <cstring>
+
+#include <arpa/inet.h>
+
+#include <tins/tins.h>
+#include <tins/constants.h>
+#include <tins/detail/pdu_helpers.h>
+
+#include <log.hpp>
+
+namespace Protocols {
+
+/*
+ * A view of Geneve header, fields are read in place from packet data
+ */
+class GENEVEHeader {
+  const uint8_t* _data;
+
+public:
+
+  static constexpr auto GENEVE_HEADER_BASE_SIZE = 8;
+  static constexpr auto GENEVE_HEADER_MAX_SIZE = GENEVE_HEADER_BASE_SIZE + 63 * 4;
+
+  /* Protocol type of Ethernet frame, e.g. of overlay network */
+  static constexpr uint16_t PROTOCOL_TEB = 0x6558;
+
+  explicit GENEVEHeader(const uint8_t* data) : _data(data) {}
+
+  /*
+   * Size of header with options, zero if it does not fit into sz or its
+   * version is unknown
+   */
+  static uint32_t header_size(const uint8_t* data, uint32_t sz) {
+    /* https://tools.ietf.org/html/rfc8926 */
+    if (sz < GENEVE_HEADER_BASE_SIZE || data[0] >> 6 != 0)
+      return 0;
+
+    uint32_t size = GENEVE_HEADER_BASE_SIZE + (data[0] & 0b00111111) * 4;
+    return size <= sz ? size : 0;
+  }
+
+  uint16_t protocol() const {
+    uint16_t protocol;
+    std::memcpy(&protocol, _data + 2, 2);
+    return ntohs(protocol);
+  }
+
+  uint32_t vni() const {
+    uint32_t vni;
+    std::memcpy(&vni, _data + 4, 4);
+    return ntohl(vni) >> 8;
+  }
+};
+
+/*
+ * A PDU for Geneve protocol
+ */
+class GENEVEPDU : public Tins::PDU {
+  std::array<uint8_t, GENEVEHeader::GENEVE_HEADER_MAX_SIZE> _buffer;
+  uint32_t _size;
+public:
+  static constexpr auto GENEVE_PORT = 6081;
+
+  static const PDU::PDUType pdu_flag;
+
+  GENEVEPDU(const uint8_t* data, uint32_t sz) {
+    _size = GENEVEHeader::header_size(data, sz);
+    if (_size == 0)
+      throw Tins::malformed_packet();
+
+    std::memcpy(_buffer.data(), data, _size);
+
+    auto protocol = GENEVEHeader{data}.protocol();
+    if (protocol == GENEVEHeader::PROTOCOL_TEB) {
+      inner_pdu(new Tins::EthernetII{data + _size, sz - _size});
+    } else {
+      inner_pdu(
+          Tins::Internals::pdu_from_flag(
+            static_cast<Tins::Constants::Ethernet::e>(protocol),
+            data + _size,
+            sz - _size,
+            true
+            )
+          );
+    }
+  }
+
+  GENEVEPDU* clone() const {
+    return new GENEVEPDU(*this);
+  }
+
+  uint32_t header_size() const {
+    return _size;
+  }
+
+  uint16_t protocol() const {
+    return GENEVEHeader{_buffer.data()}.protocol();
+  }
+
+  uint32_t vni() const {
+    return GENEVEHeader{_buffer.data()}.vni();
+  }
+
+  PDUType pdu_type() const {
+    return pdu_flag;
+  }
+
+  void write_serialization(uint8_t *data, uint32_t sz) {
+    std::memcpy(data, _buffer.data(), sz);
+  }
+};
+
+static constexpr auto GENEVEPDU_TYPE = static_cast<Tins::PDU::PDUType>(Tins::PDU::USER_DEFINED_PDU + 2);
+inline const Tins::PDU::PDUType GENEVEPDU::pdu_flag = GENEVEPDU_TYPE;
+
+}
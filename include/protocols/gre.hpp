@@ -1,5 +1,10 @@
 #pragma once
 
+#include <array>
+#include <cstring>
+
+#include <arpa/inet.h>
+
 #include <tins/tins.h>
 #include <tins/constants.h>
 #include <tins/detail/pdu_helpers.h>
@@ -9,121 +14,158 @@
 namespace Protocols {
 
 /*
- * A PDU for GRE protocol
+ * A view of GRE header, fields are read in place from packet data
  */
-class GREPDU : public Tins::PDU {
-  struct {
-    uint8_t checksum_present;
-    uint8_t key_present;
-    uint8_t seq_present;
+class GREHeader {
+  const uint8_t* _data;
+
+public:
+
+  static constexpr auto GRE_HEADER_BASE_SIZE = 4;
+  static constexpr auto GRE_HEADER_MAX_SIZE = 16;
+
+  explicit GREHeader(const uint8_t* data) : _data(data) {}
+
+  /*
+   * Size of header with optional fields, zero if it does not fit into sz
+   */
+  static uint32_t header_size(const uint8_t* data, uint32_t sz) {
+    if (sz < GRE_HEADER_BASE_SIZE)
+      return 0;
+
+    /* https://tools.ietf.org/html/rfc2890 */
+    uint32_t size = GRE_HEADER_BASE_SIZE
+      + 4 * (!!(data[0] & 0b10000000) + !!(data[0] & 0b00100000)
+          + !!(data[0] & 0b00010000));
+
+    return size <= sz ? size : 0;
+  }
+
+  uint8_t checksum_present() const {
+    return _data[0] & 0b10000000;
+  }
+
+  uint8_t key_present() const {
+    return _data[0] & 0b00100000;
+  }
+
+  uint8_t seq_present() const {
+    return _data[0] & 0b00010000;
+  }
+
+  uint16_t protocol() const {
     uint16_t protocol;
-    uint16_t checksum;
-    uint32_t key;
-    uint32_t seq;
-  } _header;
+    std::memcpy(&protocol, _data + 2, 2);
+    return ntohs(protocol);
+  }
+
+  uint16_t checksum() const {
+    uint16_t checksum = 0;
+    if (checksum_present())
+      std::memcpy(&checksum, _data + GRE_HEADER_BASE_SIZE, 2);
+    return ntohs(checksum);
+  }
+
+  uint32_t key() const {
+    uint32_t key = 0;
+    if (key_present())
+      std::memcpy(&key, _data + GRE_HEADER_BASE_SIZE
+          + (checksum_present() ? 4 : 0), 4);
+    return ntohl(key);
+  }
+
+  uint32_t seq() const {
+    uint32_t seq = 0;
+    if (seq_present())
+      std::memcpy(&seq, _data + GRE_HEADER_BASE_SIZE
+          + (checksum_present() ? 4 : 0) + (key_present() ? 4 : 0), 4);
+    return ntohl(seq);
+  }
+};
 
+/*
+ * A PDU for GRE protocol
+ */
+class GREPDU : public Tins::PDU {
+  std::array<uint8_t, GREHeader::GRE_HEADER_MAX_SIZE> _buffer;
   uint32_t _size;
 
+  GREHeader header() const {
+    return GREHeader{_buffer.data()};
+  }
+
 public:
 
     static const PDU::PDUType pdu_flag;
 
-    static constexpr auto GRE_HEADER_BASE_SIZE = 4;
+    static constexpr auto GRE_HEADER_BASE_SIZE = GREHeader::GRE_HEADER_BASE_SIZE;
 
-    /* https://tools.ietf.org/html/rfc2890 */
     GREPDU(const uint8_t* data, uint32_t sz) {
-      uint8_t bits = *data;
-      _header.checksum_present = bits & 0b10000000;
-      _header.key_present = bits & 0b00100000;
-      _header.seq_present = bits & 0b00010000;
-
-      std::memcpy(&_header.protocol, data + 2, 2);
-      _header.protocol = htons(_header.protocol);
-
-      const uint8_t* pos = data + GRE_HEADER_BASE_SIZE;
-      _size = GRE_HEADER_BASE_SIZE;
-      if (_header.checksum_present) {
-        std::memcpy(&_header.checksum, pos, 2);
-        _header.checksum = ntohs(_header.checksum);
-        pos += 4;
-        _size += 4;
-      }
-      if (_header.key_present) {
-        std::memcpy(&_header.key, pos, 4);
-        _header.key = ntohl(_header.key);
-        pos += 4;
-        _size += 4;
-      }
-      if (_header.seq_present) {
-        std::memcpy(&_header.seq, pos, 4);
-        _header.seq = ntohl(_header.seq);
-        pos += 4;
-        _size += 4;
-      }
-
-      buffer_.insert(buffer_.end(), data, pos);
+      _size = GREHeader::header_size(data, sz);
+      if (_size == 0)
+        throw Tins::malformed_packet();
+
+      std::memcpy(_buffer.data(), data, _size);
 
       inner_pdu(
           Tins::Internals::pdu_from_flag(
-            static_cast<Tins::Constants::Ethernet::e>(_header.protocol),
+            static_cast<Tins::Constants::Ethernet::e>(header().protocol()),
             data + _size,
             sz - _size,
             true
             )
           );
     }
-    
+
     /*
      * Clones the PDU. This method is used when copying PDUs.
      */
     GREPDU* clone() const {
         return new GREPDU(*this);
     }
-    
+
     uint32_t header_size() const {
       return _size;
     }
 
     uint8_t checksum_present() const {
-      return _header.checksum_present;
+      return header().checksum_present();
     }
 
     uint8_t key_present() const {
-      return _header.key_present;
+      return header().key_present();
     }
 
     uint8_t seq_present() const {
-      return _header.seq_present;
+      return header().seq_present();
     }
 
     uint16_t protocol() const {
-      return _header.protocol;
+      return header().protocol();
     }
 
     uint16_t checksum() const {
-      return _header.checksum;
+      return header().checksum();
     }
 
     uint32_t key() const {
-      return _header.key;
+      return header().key();
     }
-    
+
     uint32_t seq() const {
-      return _header.seq;
+      return header().seq();
     }
 
     PDUType pdu_type() const {
       return pdu_flag;
     }
-    
+
     void write_serialization(uint8_t *data, uint32_t sz) {
-      std::memcpy(data, buffer_.data(), sz);
+      std::memcpy(data, _buffer.data(), sz);
     }
-private:
-    std::vector<uint8_t> buffer_;
 };
 
 static constexpr auto GREPDU_TYPE = static_cast<Tins::PDU::PDUType>(Tins::PDU::USER_DEFINED_PDU + 0);
-const Tins::PDU::PDUType GREPDU::pdu_flag = GREPDU_TYPE;
+inline const Tins::PDU::PDUType GREPDU::pdu_flag = GREPDU_TYPE;
 
 }
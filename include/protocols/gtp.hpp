@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <cstring>
+
+#include <arpa/inet.h>
+
+#include <tins/tins.h>
+
+#include <log.hpp>
+
+namespace Protocols {
+
+/*
+ * A view of GTP-U header, fields are read in place from packet data
+ */
+class GTPHeader {
+  const uint8_t* _data;
+
+public:
+
+  static constexpr auto GTP_HEADER_BASE_SIZE = 8;
+  static constexpr auto GTP_HEADER_MAX_SIZE = 256;
+
+  /* Message type of packets carrying user data */
+  static constexpr uint8_t MESSAGE_G_PDU = 0xff;
+
+  explicit GTPHeader(const uint8_t* data) : _data(data) {}
+
+  /*
+   * Size of header with extension headers, zero if it does not fit into
+   * sz or it is not GTPv1 header
+   */
+  static uint32_t header_size(const uint8_t* data, uint32_t sz) {
+    /* 3GPP TS 29.281 */
+    if (sz < GTP_HEADER_BASE_SIZE || (data[0] & 0b11110000) != 0b00110000)
+      return 0;
+
+    /* Sequence number, N-PDU number and next extension header type are
+     * present if any of their flags is set */
+    if (!(data[0] & 0b00000111))
+      return GTP_HEADER_BASE_SIZE;
+
+    uint32_t size = GTP_HEADER_BASE_SIZE + 4;
+    if (sz < size)
+      return 0;
+
+    uint8_t next = data[0] & 0b00000100 ? data[size - 1] : 0;
+    while (next != 0) {
+      /* Extension header length is in 4 octet units and includes type
+       * of the next extension header in its last octet */
+      if (sz < size + 1 || data[size] == 0 || sz < size + data[size] * 4)
+        return 0;
+
+      size += data[size] * 4;
+      next = data[size - 1];
+    }
+
+    return size <= GTP_HEADER_MAX_SIZE ? size : 0;
+  }
+
+  uint8_t message_type() const {
+    return _data[1];
+  }
+
+  uint32_t teid() const {
+    uint32_t teid;
+    std::memcpy(&teid, _data + 4, 4);
+    return ntohl(teid);
+  }
+};
+
+/*
+ * A PDU for GTP-U protocol
+ */
+class GTPPDU : public Tins::PDU {
+  std::array<uint8_t, GTPHeader::GTP_HEADER_MAX_SIZE> _buffer;
+  uint32_t _size;
+public:
+  static constexpr auto GTP_PORT = 2152;
+
+  static const PDU::PDUType pdu_flag;
+
+  GTPPDU(const uint8_t* data, uint32_t sz) {
+    _size = GTPHeader::header_size(data, sz);
+    if (_size == 0)
+      throw Tins::malformed_packet();
+
+    std::memcpy(_buffer.data(), data, _size);
+
+    /* User data are IP packets of version in the first nibble */
+    if (GTPHeader{data}.message_type() != GTPHeader::MESSAGE_G_PDU
+        || sz == _size)
+      return;
+
+    switch (data[_size] >> 4) {
+      case 4:
+        inner_pdu(new Tins::IP{data + _size, sz - _size});
+        break;
+      case 6:
+        inner_pdu(new Tins::IPv6{data + _size, sz - _size});
+        break;
+      default:
+        break;
+    }
+  }
+
+  GTPPDU* clone() const {
+    return new GTPPDU(*this);
+  }
+
+  uint32_t header_size() const {
+    return _size;
+  }
+
+  uint8_t message_type() const {
+    return GTPHeader{_buffer.data()}.message_type();
+  }
+
+  uint32_t teid() const {
+    return GTPHeader{_buffer.data()}.teid();
+  }
+
+  PDUType pdu_type() const {
+    return pdu_flag;
+  }
+
+  void write_serialization(uint8_t *data, uint32_t sz) {
+    std::memcpy(data, _buffer.data(), sz);
+  }
+};
+
+static constexpr auto GTPPDU_TYPE = static_cast<Tins::PDU::PDUType>(Tins::PDU::USER_DEFINED_PDU + 3);
+inline const Tins::PDU::PDUType GTPPDU::pdu_flag = GTPPDU_TYPE;
+
+}
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <array>
+#include <cstring>
+
+#include <arpa/inet.h>
+
 #include <tins/tins.h>
 #include <tins/constants.h>
 #include <tins/detail/pdu_helpers.h>
@@ -8,20 +13,47 @@
 
 namespace Protocols {
 
+/*
+ * A view of VXLAN header, fields are read in place from packet data
+ */
+class VXLANHeader {
+  const uint8_t* _data;
+
+public:
+
+  static constexpr auto VXLAN_HEADER_SIZE = 8;
+
+  explicit VXLANHeader(const uint8_t* data) : _data(data) {}
+
+  /*
+   * Size of header, zero if it does not fit into sz
+   */
+  static uint32_t header_size(const uint8_t*, uint32_t sz) {
+    return sz < VXLAN_HEADER_SIZE ? 0 : VXLAN_HEADER_SIZE;
+  }
+
+  uint32_t vni() const {
+    uint32_t vni;
+    std::memcpy(&vni, _data + 4, 4);
+    return ntohl(vni) >> 8;
+  }
+};
+
 /*
  * A PDU for VXLAN protocol
  */
 class VXLANPDU : public Tins::PDU {
-  std::vector<std::uint8_t> _buffer;
-  std::uint32_t _vni;
+  std::array<std::uint8_t, VXLANHeader::VXLAN_HEADER_SIZE> _buffer;
 public:
   static constexpr auto VXLAN_PORT = 4789;
 
   static const PDU::PDUType pdu_flag;
 
-  VXLANPDU(const uint8_t* data, uint32_t sz) : _buffer(data, data + 8){
-    std::memcpy(&_vni, data + 4, 4);
-    _vni = ntohl(_vni) >> 8;
+  VXLANPDU(const uint8_t* data, uint32_t sz) {
+    if (VXLANHeader::header_size(data, sz) == 0)
+      throw Tins::malformed_packet();
+
+    std::memcpy(_buffer.data(), data, _buffer.size());
 
     inner_pdu(new Tins::EthernetII{data + 8, sz - 8});
   }
@@ -35,7 +67,7 @@ public:
   }
 
   uint32_t vni() const {
-    return _vni;
+    return VXLANHeader{_buffer.data()}.vni();
   }
 
   PDUType pdu_type() const {
@@ -48,6 +80,6 @@ public:
 };
 
 static constexpr auto VXLANPDU_TYPE = static_cast<Tins::PDU::PDUType>(Tins::PDU::USER_DEFINED_PDU + 1);
-const Tins::PDU::PDUType VXLANPDU::pdu_flag = VXLANPDU_TYPE;
+inline const Tins::PDU::PDUType VXLANPDU::pdu_flag = VXLANPDU_TYPE;
 
 }
@@ -1,4 +1,7 @@
+#pragma once
+
 #include <array>
+#include <atomic>
 
 namespace Async {
 
@@ -9,27 +12,36 @@ class Queue {
 
     std::array<T, N> _values;
     std::size_t _reader = 0;
-    volatile std::size_t _writer = 0;
+
+    /* Values are published to consumer by release of writer index */
+    std::atomic<std::size_t> _writer = 0;
 
   public:
 
-    Node* volatile _next = nullptr;
+    std::atomic<Node*> _next = nullptr;
 
     bool full() const {
-      return _writer == N;
+      return _writer.load(std::memory_order_relaxed) == N;
     }
 
     bool empty() const {
-      return _reader == _writer;
+      return _reader == _writer.load(std::memory_order_acquire);
     }
 
     bool read_end() const {
       return _reader == N;
     }
 
+    void reset() {
+      _reader = 0;
+      _writer.store(0, std::memory_order_relaxed);
+      _next.store(nullptr, std::memory_order_relaxed);
+    }
+
     void add(T&& value) {
-      _values[_writer] = std::move(value);
-      ++_writer;
+      auto writer = _writer.load(std::memory_order_relaxed);
+      _values[writer] = std::move(value);
+      _writer.store(writer + 1, std::memory_order_release);
     }
 
     T pop() {
@@ -39,37 +51,110 @@ class Queue {
     }
   };
 
-  Node* volatile _reader = new Node();
-  Node* volatile _writer = _reader;
+  /* Reader node is owned by consumer, writer node by producer */
+  Node* _reader = new Node();
+  std::atomic<Node*> _writer = _reader;
+
+  /* Nodes read by consumer are handed back to producer for reuse, so that
+   * nodes are allocated and freed by the same thread. Producer keeps only
+   * a few of them, so that memory of a burst is not held for good */
+  static constexpr std::size_t MAX_SPARE = 4;
+
+  std::atomic<Node*> _recycled = nullptr;
+  Node* _spare = nullptr;
+  std::atomic<std::size_t> _reused = 0;
+
+  Node* take_node() {
+    if (_spare == nullptr) {
+      _spare = _recycled.exchange(nullptr, std::memory_order_acquire);
+      trim(_spare);
+    }
+
+    if (_spare == nullptr)
+      return new Node();
+
+    Node* node = _spare;
+    _spare = node->_next.load(std::memory_order_relaxed);
+    node->reset();
+    _reused.store(_reused.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    return node;
+  }
+
+  void recycle(Node* node) {
+    Node* head = _recycled.load(std::memory_order_relaxed);
+    do {
+      node->_next.store(head, std::memory_order_relaxed);
+    } while (!_recycled.compare_exchange_weak(head, node,
+          std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  static void trim(Node* node) {
+    for (std::size_t i = 1; node != nullptr && i < MAX_SPARE; ++i)
+      node = node->_next.load(std::memory_order_relaxed);
+
+    if (node != nullptr) {
+      delete_nodes(node->_next.load(std::memory_order_relaxed));
+      node->_next.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  static void delete_nodes(Node* node) {
+    while (node != nullptr) {
+      Node* next = node->_next.load();
+      delete node;
+      node = next;
+    }
+  }
 
 public:
 
+  Queue() = default;
+  Queue(const Queue&) = delete;
+  Queue& operator=(const Queue&) = delete;
+
+  ~Queue() {
+    delete_nodes(_reader);
+    delete_nodes(_spare);
+    delete_nodes(_recycled.load());
+  }
+
   template<typename TT>
   void push(TT&& value) {
-    Node* writer = _writer;
+    Node* writer = _writer.load(std::memory_order_relaxed);
 
     if (writer->full()) {
-      Node* node = new Node();
-      writer->_next = node;
-      _writer = node;
+      Node* node = take_node();
+      writer->_next.store(node, std::memory_order_release);
+      _writer.store(node, std::memory_order_release);
+      writer = node;
     }
 
-    _writer->add(std::forward<TT>(value));
+    writer->add(std::forward<TT>(value));
   }
 
   T pop() {
     Node* node = _reader;
 
     if (node->read_end()) {
-      _reader = node->_next;
-      delete node;
+      /* Next node is linked before writer node moves to it */
+      _reader = node->_next.load(std::memory_order_acquire);
+      recycle(node);
     }
 
     return _reader->pop();
   }
 
   bool empty() const {
-    return _reader == _writer && _reader->empty();
+    return _reader == _writer.load(std::memory_order_acquire)
+      && _reader->empty();
+  }
+
+  /**
+   * Number of nodes reused instead of allocated, may be read by any thread.
+   */
+  std::size_t reused() const {
+    return _reused.load(std::memory_order_relaxed);
   }
 
 };
@@ -9,7 +9,7 @@
 
 /**
  * Reducer namespace handles reducing PDUs into Flow specific
- * data, such as values, fields, and digest.
+ * data, such as values and fields.
  */
 namespace Reducer {
 
@@ -78,6 +78,22 @@ public:
 
     return result;
   }
+
+  /**
+   * Loads given symbol as function pointer if the object provides it.
+   * Used for optional parts of plugin interfaces.
+   * @param sym a symbol to load.
+   * @return Function pointer or nullptr if symbol was not found.
+   */
+  template<typename T>
+  auto optional_function(const char* sym) const noexcept {
+    auto result = reinterpret_cast<T*>(dlsym(handle, sym)); // NOLINT
+
+    /* Clear error state so following lookups are not affected */
+    dlerror();
+
+    return result;
+  }
 };
 
 } // namespace Plugins
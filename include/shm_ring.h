@@ -0,0 +1,152 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Layout of shared memory ring read by ShmInput plugin.
+ *
+ * The ring is a POSIX shared memory object created by the producer. It
+ * starts with ShmRingHeader followed by slot_count slots of slot_size
+ * bytes, every slot starts with ShmSlot followed by frame data. Ring
+ * follows bounded queue of Dmitry Vyukov, so any number of producers may
+ * write into it while flower is the only consumer.
+ *
+ * Slot at position pos is free when its sequence equals pos and holds
+ * a frame when its sequence equals pos + 1. Consumer frees the slot by
+ * setting its sequence to pos + slot_count. All fields are in host byte
+ * order, positions only grow and are never wrapped.
+ */
+
+#define SHM_RING_MAGIC 0x52574C46
+#define SHM_RING_VERSION 1
+#define SHM_RING_ALIGN 64
+
+/**
+ * Header of the ring, counters are padded to separate cache lines.
+ */
+struct ShmRingHeader {
+  uint32_t magic;
+  uint32_t version;
+
+  /**
+   * Number of slots, must be a power of two.
+   */
+  uint32_t slot_count;
+
+  /**
+   * Size of one slot including ShmSlot, multiple of SHM_RING_ALIGN.
+   */
+  uint32_t slot_size;
+
+  /**
+   * Set to non zero by producer once no more frames will be written.
+   */
+  uint32_t closed;
+  uint8_t pad0[SHM_RING_ALIGN - 5 * sizeof(uint32_t)];
+
+  /**
+   * Position of the next slot to be written by producers.
+   */
+  uint64_t head;
+  uint8_t pad1[SHM_RING_ALIGN - sizeof(uint64_t)];
+
+  /**
+   * Position of the next slot to be read, written only by consumer so
+   * that it can attach again after restart.
+   */
+  uint64_t tail;
+  uint8_t pad2[SHM_RING_ALIGN - sizeof(uint64_t)];
+
+  /**
+   * Number of frames producers dropped because the ring was full.
+   */
+  uint64_t drops;
+  uint8_t pad3[SHM_RING_ALIGN - sizeof(uint64_t)];
+};
+
+/**
+ * Header of one slot, frame data follow immediately.
+ */
+struct ShmSlot {
+  uint64_t sequence;
+  uint32_t len;
+  uint32_t caplen;
+  uint32_t sec;
+  uint32_t usec;
+  uint32_t interface;
+  uint32_t reserved;
+};
+
+#define SHM_RING_HEADER_SIZE sizeof(struct ShmRingHeader)
+
+static inline uint64_t
+shm_ring_size(uint32_t slot_count, uint32_t slot_size)
+{
+  return SHM_RING_HEADER_SIZE + (uint64_t)slot_count * slot_size;
+}
+
+static inline struct ShmSlot *
+shm_ring_slot(struct ShmRingHeader *ring, uint64_t pos)
+{
+  return (struct ShmSlot *)((unsigned char *)ring + SHM_RING_HEADER_SIZE
+      + (pos & (ring->slot_count - 1)) * ring->slot_size);
+}
+
+static inline unsigned char *
+shm_slot_data(struct ShmSlot *slot)
+{
+  return (unsigned char *)(slot + 1);
+}
+
+/**
+ * Initializes zero filled ring created by producer. Magic is written
+ * last, consumer must not use the ring until it is set.
+ */
+static inline void
+shm_ring_init(struct ShmRingHeader *ring, uint32_t slot_count,
+    uint32_t slot_size)
+{
+  ring->version = SHM_RING_VERSION;
+  ring->slot_count = slot_count;
+  ring->slot_size = slot_size;
+
+  for (uint64_t pos = 0; pos < slot_count; ++pos)
+    shm_ring_slot(ring, pos)->sequence = pos;
+
+  __atomic_store_n(&ring->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+}
+
+/**
+ * Reserves slot for writing. Returns NULL if the ring is full. Safe to be
+ * called by multiple producers, frame is published by shm_ring_publish.
+ */
+static inline struct ShmSlot *
+shm_ring_reserve(struct ShmRingHeader *ring)
+{
+  uint64_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+  for (;;) {
+    struct ShmSlot *slot = shm_ring_slot(ring, pos);
+    uint64_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    int64_t diff = (int64_t)(seq - pos);
+
+    if (diff < 0)
+      return 0;
+
+    if (diff == 0 && __atomic_compare_exchange_n(&ring->head, &pos, pos + 1,
+          1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      return slot;
+
+    if (diff > 0)
+      pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ * Makes frame written to reserved slot visible to consumer.
+ */
+static inline void
+shm_ring_publish(struct ShmSlot *slot)
+{
+  __atomic_store_n(&slot->sequence, slot->sequence + 1, __ATOMIC_RELEASE);
+}
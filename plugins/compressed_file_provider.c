@@ -0,0 +1,387 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <input.h>
+
+#define MAGIC_USEC 0xa1b2c3d4
+#define MAGIC_NSEC 0xa1b23c4d
+#define GLOBAL_HEADER_SIZE 24
+#define RECORD_HEADER_SIZE 16
+
+#define BUFFER_SIZE (8 << 20)
+#define BUFFER_COUNT 4
+#define READ_BUFFER_SIZE (1 << 20)
+
+/**
+ * Buffer of decompressed stream. Buffers always end at record boundary,
+ * the incomplete tail is carried over to the next buffer by decompressor.
+ */
+struct Buffer {
+  unsigned char *data;
+  size_t len;
+};
+
+static struct Buffer buffers[BUFFER_COUNT];
+
+/* Ring state shared with decompression thread */
+static pthread_t thread;
+static int thread_started;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static unsigned int full;
+static int finished;
+static int failed;
+static int stopped;
+
+/* Consumer state */
+static unsigned int tail;
+static struct Buffer *current;
+static size_t position;
+
+static int swapped;
+static int nanoseconds;
+
+/* Decompressors */
+#ifdef HAVE_ZSTD
+static const unsigned char ZSTD_FRAME[] = {0x28, 0xb5, 0x2f, 0xfd};
+#endif
+
+static gzFile gz;
+#ifdef HAVE_ZSTD
+static FILE *file;
+static ZSTD_DCtx *zstd;
+static unsigned char *zstd_in;
+static ZSTD_inBuffer zstd_input;
+#endif
+
+InfoRT
+info()
+{
+  return (InfoRT){
+    "CompressedFileInput",
+    INPUT_PLUGIN,
+    "Input from compressed file in pcap format\n"
+    "The argument is a path to the pcap file compressed by gzip"
+#ifdef HAVE_ZSTD
+    " or zstd"
+#endif
+    ",\nuncompressed files are accepted as well. Decompression runs\n"
+    "in a separate thread\n"
+  };
+}
+
+static uint32_t
+read32(const unsigned char *data)
+{
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return swapped ? __builtin_bswap32(value) : value;
+}
+
+#ifdef HAVE_ZSTD
+static long
+read_zstd(unsigned char *out, size_t cap)
+{
+  ZSTD_outBuffer output = {out, cap, 0};
+
+  while (output.pos < output.size) {
+    if (zstd_input.pos == zstd_input.size) {
+      zstd_input.size = fread(zstd_in, 1, READ_BUFFER_SIZE, file);
+      zstd_input.pos = 0;
+
+      if (!zstd_input.size)
+        return ferror(file) ? -1 : (long)output.pos;
+    }
+
+    if (ZSTD_isError(ZSTD_decompressStream(zstd, &output, &zstd_input)))
+      return -1;
+  }
+
+  return output.pos;
+}
+#endif
+
+/**
+ * Reads up to cap decompressed bytes. Less bytes are returned
+ * only at the end of stream, negative value on error.
+ */
+static long
+read_stream(unsigned char *out, size_t cap)
+{
+#ifdef HAVE_ZSTD
+  if (zstd)
+    return read_zstd(out, cap);
+#endif
+
+  size_t total = 0;
+
+  while (total < cap) {
+    int n = gzread(gz, out + total, cap - total);
+    if (n < 0)
+      return -1;
+    if (n == 0)
+      break;
+    total += n;
+  }
+
+  return total;
+}
+
+/**
+ * Finds end of the last complete record in buffer.
+ */
+static size_t
+record_boundary(const unsigned char *data, size_t len)
+{
+  size_t offset = 0;
+
+  while (len - offset >= RECORD_HEADER_SIZE) {
+    size_t record = RECORD_HEADER_SIZE + read32(data + offset + 8);
+
+    if (len - offset < record)
+      break;
+
+    offset += record;
+  }
+
+  return offset;
+}
+
+static void *
+decompress_worker(void *arg)
+{
+  (void)arg;
+  unsigned int head = 0;
+  const unsigned char *carry = NULL;
+  size_t carry_len = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&lock);
+    while (full == BUFFER_COUNT && !stopped)
+      pthread_cond_wait(&cond, &lock);
+    int stop = stopped;
+    pthread_mutex_unlock(&lock);
+
+    if (stop)
+      break;
+
+    struct Buffer *buffer = &buffers[head];
+    memmove(buffer->data, carry, carry_len);
+
+    long n = read_stream(buffer->data + carry_len, BUFFER_SIZE - carry_len);
+    size_t len = carry_len + (n > 0 ? n : 0);
+    int end = n >= 0 && len < BUFFER_SIZE;
+
+    /* Record larger than whole buffer can not be framed */
+    buffer->len = record_boundary(buffer->data, len);
+    if (n < 0 || (!end && !buffer->len)) {
+      pthread_mutex_lock(&lock);
+      failed = 1;
+      pthread_cond_broadcast(&cond);
+      pthread_mutex_unlock(&lock);
+      break;
+    }
+
+    carry = buffer->data + buffer->len;
+    carry_len = len - buffer->len;
+    head = (head + 1) % BUFFER_COUNT;
+
+    pthread_mutex_lock(&lock);
+    ++full;
+    finished = end;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+
+    if (end)
+      break;
+  }
+
+  return NULL;
+}
+
+static int
+open_stream(const char *arg)
+{
+  unsigned char magic[4] = {0};
+  FILE *probe = fopen(arg, "rb");
+
+  if (!probe)
+    return 0;
+
+  size_t n = fread(magic, 1, sizeof(magic), probe);
+  fclose(probe);
+
+#ifdef HAVE_ZSTD
+  if (n == sizeof(magic) && !memcmp(magic, ZSTD_FRAME, sizeof(magic))) {
+    file = fopen(arg, "rb");
+    zstd = ZSTD_createDCtx();
+    zstd_in = malloc(READ_BUFFER_SIZE);
+    zstd_input = (ZSTD_inBuffer){zstd_in, 0, 0};
+
+    return file && zstd && zstd_in;
+  }
+#else
+  (void)n;
+#endif
+
+  /* Zlib reads both gzip and uncompressed files */
+  gz = gzopen(arg, "rb");
+  if (!gz)
+    return 0;
+
+  gzbuffer(gz, READ_BUFFER_SIZE);
+
+  return 1;
+}
+
+InitRT
+init(const char *arg)
+{
+  if (!open_stream(arg))
+    return (InitRT){RESULT_ERROR, "Could not open compressed file"};
+
+  unsigned char header[GLOBAL_HEADER_SIZE];
+  if (read_stream(header, sizeof(header)) != GLOBAL_HEADER_SIZE)
+    return (InitRT){RESULT_ERROR, "File is too short to be pcap"};
+
+  uint32_t magic;
+  memcpy(&magic, header, sizeof(magic));
+  swapped = magic == __builtin_bswap32(MAGIC_USEC)
+    || magic == __builtin_bswap32(MAGIC_NSEC);
+  magic = read32(header);
+
+  if (magic != MAGIC_USEC && magic != MAGIC_NSEC)
+    return (InitRT){RESULT_ERROR, "Unknown pcap magic number"};
+
+  nanoseconds = magic == MAGIC_NSEC;
+
+  for (unsigned int i = 0; i < BUFFER_COUNT; ++i) {
+    buffers[i].data = malloc(BUFFER_SIZE);
+    if (!buffers[i].data)
+      return (InitRT){RESULT_ERROR, "Could not allocate buffers"};
+  }
+
+  if (pthread_create(&thread, NULL, decompress_worker, NULL))
+    return (InitRT){RESULT_ERROR, "Could not start decompression thread"};
+  thread_started = 1;
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+FinalizeRT
+finalize()
+{
+  if (thread_started) {
+    pthread_mutex_lock(&lock);
+    stopped = 1;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+
+    pthread_join(thread, NULL);
+  }
+
+  for (unsigned int i = 0; i < BUFFER_COUNT; ++i)
+    free(buffers[i].data);
+
+  if (gz)
+    gzclose(gz);
+
+#ifdef HAVE_ZSTD
+  if (file)
+    fclose(file);
+  ZSTD_freeDCtx(zstd);
+  free(zstd_in);
+#endif
+}
+
+/**
+ * Makes sure there are records left in the current buffer. Consumed buffer
+ * is given back to decompression thread once all of its records were
+ * handed out.
+ */
+static enum GetPacketResultType
+ensure_records()
+{
+  while (!current || position == current->len) {
+    pthread_mutex_lock(&lock);
+
+    if (current) {
+      current = NULL;
+      tail = (tail + 1) % BUFFER_COUNT;
+      --full;
+      pthread_cond_broadcast(&cond);
+    }
+
+    while (!full && !finished && !failed)
+      pthread_cond_wait(&cond, &lock);
+
+    /* Result is read under lock, decompression thread writes it */
+    enum GetPacketResultType result = CAPTURE_PACKET;
+    if (full) {
+      current = &buffers[tail];
+      position = 0;
+    } else {
+      result = failed ? CAPTURE_INPUT_ERROR : CAPTURE_END_OF_INPUT;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    if (result != CAPTURE_PACKET)
+      return result;
+  }
+
+  return CAPTURE_PACKET;
+}
+
+static struct Packet
+take_record()
+{
+  const unsigned char *data = current->data + position;
+  uint32_t caplen = read32(data + 8);
+
+  position += RECORD_HEADER_SIZE + caplen;
+
+  return (struct Packet){
+    data + RECORD_HEADER_SIZE,
+    read32(data + 12),
+    caplen,
+    read32(data),
+    nanoseconds ? read32(data + 4) / 1000 : read32(data + 4)
+  };
+}
+
+GetPacketRT
+get_packet()
+{
+  enum GetPacketResultType type = ensure_records();
+  if (type != CAPTURE_PACKET)
+    return (GetPacketRT){type, {}};
+
+  return (GetPacketRT){CAPTURE_PACKET, take_record()};
+}
+
+/**
+ * Function get packets returns up to max records of one buffer, so that
+ * the whole batch stays valid until the next call.
+ */
+GetPacketsRT
+get_packets(struct Packet *out, unsigned int max)
+{
+  enum GetPacketResultType type = ensure_records();
+  if (type != CAPTURE_PACKET)
+    return (GetPacketsRT){type, 0};
+
+  unsigned int count = 0;
+  while (count < max && position < current->len)
+    out[count++] = take_record();
+
+  return (GetPacketsRT){CAPTURE_PACKET, count};
+}
@@ -0,0 +1,316 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <input.h>
+
+#define MAGIC_USEC 0xa1b2c3d4
+#define MAGIC_NSEC 0xa1b23c4d
+#define GLOBAL_HEADER_SIZE 24
+#define RECORD_HEADER_SIZE 16
+
+/* Amount of the next file read ahead, sequential readahead does the rest */
+#define PREFETCH_SIZE (64 << 20)
+
+#define USEC_PER_SEC 1000000
+
+/**
+ * Capture file of the set together with timestamp of its first packet.
+ */
+struct File {
+  char *path;
+  uint64_t start;
+};
+
+static glob_t paths;
+static struct File *files;
+static size_t file_count;
+static size_t file_index;
+
+/* Currently mapped file */
+static const unsigned char *map = MAP_FAILED;
+static size_t size;
+static size_t offset;
+static int swapped;
+static int nanoseconds;
+
+/* Next file opened for prefetching */
+static int next_fd = -1;
+
+static char errbuf[256];
+
+InfoRT
+info()
+{
+  return (InfoRT){
+    "DirectoryInput",
+    INPUT_PLUGIN,
+    "Input from a set of pcap files processed as one stream\n"
+    "The argument is a directory or a glob pattern, e.g. 'dumps/*.pcap'.\n"
+    "Files are ordered by timestamp of their first packet and the next\n"
+    "file is read ahead while the current one is processed\n"
+  };
+}
+
+static uint32_t
+read32(const unsigned char *data)
+{
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return swapped ? __builtin_bswap32(value) : value;
+}
+
+/**
+ * Checks pcap magic of global header and sets byte order
+ * and timestamp precision accordingly.
+ */
+static int
+parse_header(const unsigned char *header)
+{
+  uint32_t magic;
+  memcpy(&magic, header, sizeof(magic));
+  swapped = magic == __builtin_bswap32(MAGIC_USEC)
+    || magic == __builtin_bswap32(MAGIC_NSEC);
+  magic = read32(header);
+
+  if (magic != MAGIC_USEC && magic != MAGIC_NSEC)
+    return 0;
+
+  nanoseconds = magic == MAGIC_NSEC;
+
+  return 1;
+}
+
+/**
+ * Reads timestamp of the first packet in microseconds. Files that are not
+ * pcap files are skipped, empty files are ordered first.
+ */
+static int
+first_timestamp(const char *path, uint64_t *start)
+{
+  unsigned char header[GLOBAL_HEADER_SIZE + RECORD_HEADER_SIZE];
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    return 0;
+
+  ssize_t n = pread(fd, header, sizeof(header), 0);
+  close(fd);
+
+  if (n < GLOBAL_HEADER_SIZE || !parse_header(header))
+    return 0;
+
+  *start = 0;
+  if (n == sizeof(header)) {
+    uint32_t frac = read32(header + GLOBAL_HEADER_SIZE + 4);
+    *start = (uint64_t)read32(header + GLOBAL_HEADER_SIZE) * USEC_PER_SEC
+      + (nanoseconds ? frac / 1000 : frac);
+  }
+
+  return 1;
+}
+
+static int
+compare_files(const void *f, const void *s)
+{
+  const struct File *first = f;
+  const struct File *second = s;
+
+  if (first->start != second->start)
+    return first->start < second->start ? -1 : 1;
+
+  return strcmp(first->path, second->path);
+}
+
+static void
+prefetch(size_t index)
+{
+  if (next_fd >= 0)
+    close(next_fd);
+  next_fd = -1;
+
+  if (index >= file_count)
+    return;
+
+  next_fd = open(files[index].path, O_RDONLY);
+  if (next_fd >= 0)
+    posix_fadvise(next_fd, 0, PREFETCH_SIZE, POSIX_FADV_WILLNEED);
+}
+
+static void
+unmap_file()
+{
+  if (map != MAP_FAILED)
+    munmap((void *)map, size);
+  map = MAP_FAILED;
+}
+
+/**
+ * Maps file at index and starts prefetching of the following one.
+ * Returns zero on failure.
+ */
+static int
+map_file(size_t index)
+{
+  unmap_file();
+
+  int fd = open(files[index].path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+
+  struct stat st;
+  if (fstat(fd, &st) || (size_t)st.st_size < GLOBAL_HEADER_SIZE) {
+    close(fd);
+    return 0;
+  }
+  size = st.st_size;
+
+  map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return 0;
+
+  madvise((void *)map, size, MADV_SEQUENTIAL);
+
+  if (!parse_header(map))
+    return 0;
+
+  offset = GLOBAL_HEADER_SIZE;
+  prefetch(index + 1);
+
+  return 1;
+}
+
+InitRT
+init(const char *arg)
+{
+  struct stat st;
+  int status;
+
+  if (!stat(arg, &st) && S_ISDIR(st.st_mode)) {
+    char pattern[PATH_MAX];
+    snprintf(pattern, sizeof(pattern), "%s/*", arg);
+    status = glob(pattern, 0, NULL, &paths);
+  } else {
+    status = glob(arg, 0, NULL, &paths);
+  }
+
+  if (status == GLOB_NOMATCH)
+    return (InitRT){RESULT_ERROR, "No files match the argument"};
+  if (status)
+    return (InitRT){RESULT_ERROR, "Could not list files"};
+
+  files = calloc(paths.gl_pathc, sizeof(*files));
+  if (!files)
+    return (InitRT){RESULT_ERROR, "Could not allocate file list"};
+
+  for (size_t i = 0; i < paths.gl_pathc; ++i) {
+    struct File file = {paths.gl_pathv[i], 0};
+
+    if (first_timestamp(file.path, &file.start))
+      files[file_count++] = file;
+  }
+
+  if (!file_count)
+    return (InitRT){RESULT_ERROR, "No pcap files found"};
+
+  qsort(files, file_count, sizeof(*files), compare_files);
+
+  if (!map_file(0)) {
+    snprintf(errbuf, sizeof(errbuf), "%s: %s", files[0].path, strerror(errno));
+    return (InitRT){RESULT_ERROR, errbuf};
+  }
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+FinalizeRT
+finalize()
+{
+  unmap_file();
+  prefetch(file_count);
+
+  free(files);
+  globfree(&paths);
+}
+
+static int
+record_available()
+{
+  return map != MAP_FAILED && size - offset >= RECORD_HEADER_SIZE
+    && size - offset - RECORD_HEADER_SIZE >= read32(map + offset + 8);
+}
+
+/**
+ * Makes sure there is a complete record in the current file, moving
+ * to the next file when needed. Truncated records end the file.
+ */
+static int
+ensure_record()
+{
+  for (;;) {
+    if (record_available())
+      return 1;
+
+    /* Files that can not be mapped are skipped */
+    do {
+      if (++file_index >= file_count) {
+        unmap_file();
+        return 0;
+      }
+    } while (!map_file(file_index));
+  }
+}
+
+static struct Packet
+take_record()
+{
+  const unsigned char *data = map + offset;
+  uint32_t caplen = read32(data + 8);
+  uint32_t frac = read32(data + 4);
+
+  offset += RECORD_HEADER_SIZE + caplen;
+
+  return (struct Packet){
+    data + RECORD_HEADER_SIZE,
+    read32(data + 12),
+    caplen,
+    read32(data),
+    nanoseconds ? frac / 1000 : frac
+  };
+}
+
+GetPacketRT
+get_packet()
+{
+  if (!ensure_record())
+    return (GetPacketRT){CAPTURE_END_OF_INPUT, {}};
+
+  return (GetPacketRT){CAPTURE_PACKET, take_record()};
+}
+
+/**
+ * Function get packets returns up to max records of one file, so that
+ * the whole batch stays valid until the next call.
+ */
+GetPacketsRT
+get_packets(struct Packet *out, unsigned int max)
+{
+  if (!ensure_record())
+    return (GetPacketsRT){CAPTURE_END_OF_INPUT, 0};
+
+  unsigned int count = 0;
+  do {
+    out[count++] = take_record();
+  } while (count < max && record_available());
+
+  return (GetPacketsRT){CAPTURE_PACKET, count};
+}
@@ -0,0 +1,446 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <rte_eal.h>
+#include <rte_errno.h>
+#include <rte_ethdev.h>
+#include <rte_lcore.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+
+#include <input.h>
+
+#define DEFAULT_DESCRIPTORS 1024
+#define MEMPOOL_CACHE 256
+#define MAX_BURST 512
+#define MAX_QUEUES 64
+#define MAX_EAL_ARGS 64
+#define ARG_SIZE 1024
+
+/**
+ * One receive queue of the port read by its own thread. Mbufs of the last
+ * get_packets burst are kept until the next call.
+ */
+struct Queue {
+  struct rte_mbuf *pending[MAX_BURST];
+  unsigned int pending_count;
+  int registered;
+};
+
+static struct Queue queues[MAX_QUEUES];
+static unsigned int queue_total = 1;
+static uint16_t port = 0;
+static unsigned int mbufs = 0;
+static uint16_t descriptors = DEFAULT_DESCRIPTORS;
+static int lro = 0;
+
+static struct rte_mempool *pool = NULL;
+static int eal_ready = 0;
+static int port_started = 0;
+
+static char errbuf[256];
+
+/* Symmetric Toeplitz key, both directions of a flow land in one queue.
+ * It is filled to the key size of the port */
+static uint8_t rss_key[UINT8_MAX];
+
+InfoRT
+info()
+{
+  return (InfoRT){
+    "DpdkInput",
+    INPUT_PLUGIN,
+    "Input from DPDK ethernet port using burst receive\n"
+    "The argument is comma separated options optionally followed by a space\n"
+    "and EAL arguments, e.g. queues=2 --no-huge --vdev=net_pcap0,iface=eth0\n"
+    "  port        - id of DPDK port [default: 0]\n"
+    "  queues      - number of receive queues spread by symmetric RSS, each\n"
+    "                with its own processing pipeline [default: 1]\n"
+    "  mbufs       - number of mbufs in packet pool, at least enough for\n"
+    "                descriptors of all queues and caches of threads\n"
+    "                [default: computed]\n"
+    "  descriptors - number of descriptors of one receive queue\n"
+    "                [default: 1024]\n"
+    "  lro         - 1 to let port coalesce TCP segments, they are still\n"
+    "                counted one by one [default: 0]\n"
+  };
+}
+
+static InitRT
+error(const char *msg, int code)
+{
+  snprintf(errbuf, sizeof(errbuf), "%s: %s", msg, rte_strerror(code));
+  return (InitRT){RESULT_ERROR, errbuf};
+}
+
+/**
+ * Parses plugin argument. Comma separated key=value options come first,
+ * everything after the first space is passed to EAL split by spaces.
+ */
+static int
+parse_arg(const char *arg, int *argc, char **argv)
+{
+  static char copy[ARG_SIZE];
+  char *save;
+
+  strncpy(copy, arg, sizeof(copy) - 1);
+
+  char *eal = strchr(copy, ' ');
+  if (eal)
+    *eal++ = '\0';
+
+  argv[(*argc)++] = "flower";
+  if (eal) {
+    for (char *token = strtok_r(eal, " ", &save); token;
+        token = strtok_r(NULL, " ", &save)) {
+      if (*argc == MAX_EAL_ARGS)
+        return 0;
+      argv[(*argc)++] = token;
+    }
+  }
+
+  for (char *token = strtok_r(copy, ",", &save); token;
+      token = strtok_r(NULL, ",", &save)) {
+    char *value = strchr(token, '=');
+    if (!value)
+      return 0;
+    *value++ = '\0';
+
+    unsigned long number = strtoul(value, NULL, 0);
+    if (!strcmp(token, "port"))
+      port = number;
+    else if (!strcmp(token, "queues"))
+      queue_total = number;
+    else if (!strcmp(token, "mbufs"))
+      mbufs = number;
+    else if (!strcmp(token, "descriptors"))
+      descriptors = number;
+    else if (!strcmp(token, "lro"))
+      lro = number;
+    else
+      return 0;
+  }
+
+  return queue_total && queue_total <= MAX_QUEUES;
+}
+
+/**
+ * Creates packet pool large enough to fill descriptors of all queues,
+ * caches of EAL lcores and of registered capture and processing threads,
+ * and the burst every queue keeps until the next call.
+ */
+static InitRT
+create_pool()
+{
+  unsigned int caches = rte_lcore_count() + 2 * queue_total;
+  unsigned int needed = queue_total * (descriptors + MAX_BURST)
+    + caches * MEMPOOL_CACHE * 3 / 2;
+
+  if (mbufs < needed)
+    mbufs = needed;
+
+  pool = rte_pktmbuf_pool_create("flower", mbufs, MEMPOOL_CACHE, 0,
+      RTE_MBUF_DEFAULT_BUF_SIZE, rte_eth_dev_socket_id(port));
+  if (!pool)
+    return error("rte_pktmbuf_pool_create", rte_errno);
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+/**
+ * Configures port with one receive queue per pipeline. With more queues
+ * flows are spread by RSS restricted to hash types the port supports.
+ */
+static InitRT
+configure_port()
+{
+  struct rte_eth_dev_info dev_info;
+  int ret = rte_eth_dev_info_get(port, &dev_info);
+  if (ret)
+    return error("rte_eth_dev_info_get", -ret);
+
+  if (queue_total > dev_info.max_rx_queues)
+    return (InitRT){RESULT_ERROR, "Port has not enough receive queues"};
+
+  struct rte_eth_conf conf;
+  memset(&conf, 0, sizeof(conf));
+
+  /* Ports without key size take their default key, which may not be
+   * symmetric */
+  if (queue_total > 1) {
+    for (unsigned int i = 0; i < dev_info.hash_key_size; ++i)
+      rss_key[i] = i % 2 ? 0x5a : 0x6d;
+
+    conf.rxmode.mq_mode = RTE_ETH_MQ_RX_RSS;
+    conf.rx_adv_conf.rss_conf.rss_key = dev_info.hash_key_size
+      ? rss_key : NULL;
+    conf.rx_adv_conf.rss_conf.rss_key_len = dev_info.hash_key_size;
+    /* IPv6 extension header types would hash addresses from options */
+    conf.rx_adv_conf.rss_conf.rss_hf = (RTE_ETH_RSS_IP | RTE_ETH_RSS_TCP
+        | RTE_ETH_RSS_UDP) & ~(RTE_ETH_RSS_IPV6_EX | RTE_ETH_RSS_IPV6_TCP_EX
+        | RTE_ETH_RSS_IPV6_UDP_EX) & dev_info.flow_type_rss_offloads;
+  }
+
+  if (lro) {
+    if (!(dev_info.rx_offload_capa & RTE_ETH_RX_OFFLOAD_TCP_LRO))
+      return (InitRT){RESULT_ERROR, "Port does not support LRO"};
+
+    conf.rxmode.offloads |= RTE_ETH_RX_OFFLOAD_TCP_LRO;
+    conf.rxmode.max_lro_pkt_size = dev_info.max_lro_pkt_size;
+  }
+
+  ret = rte_eth_dev_configure(port, queue_total, 0, &conf);
+  if (ret)
+    return error("rte_eth_dev_configure", -ret);
+
+  uint16_t tx_descriptors = 0;
+  ret = rte_eth_dev_adjust_nb_rx_tx_desc(port, &descriptors, &tx_descriptors);
+  if (ret)
+    return error("rte_eth_dev_adjust_nb_rx_tx_desc", -ret);
+
+  InitRT result = create_pool();
+  if (result.type != RESULT_OK)
+    return result;
+
+  int socket = rte_eth_dev_socket_id(port);
+  for (unsigned int i = 0; i < queue_total; ++i) {
+    ret = rte_eth_rx_queue_setup(port, i, descriptors, socket, NULL, pool);
+    if (ret)
+      return error("rte_eth_rx_queue_setup", -ret);
+  }
+
+  ret = rte_eth_dev_start(port);
+  if (ret)
+    return error("rte_eth_dev_start", -ret);
+  port_started = 1;
+
+  /* Not every PMD supports promiscuous mode, e.g. pcap files */
+  rte_eth_promiscuous_enable(port);
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+InitRT
+init(const char *arg)
+{
+  char *argv[MAX_EAL_ARGS + 1] = {0};
+  int argc = 0;
+
+  if (!parse_arg(arg, &argc, argv))
+    return (InitRT){RESULT_ERROR, "Invalid plugin argument"};
+
+  if (rte_eal_init(argc, argv) < 0)
+    return error("rte_eal_init", rte_errno);
+  eal_ready = 1;
+
+  if (!rte_eth_dev_is_valid_port(port))
+    return (InitRT){RESULT_ERROR, "Invalid DPDK port"};
+
+  return configure_port();
+}
+
+FinalizeRT
+finalize()
+{
+  for (unsigned int i = 0; i < MAX_QUEUES; ++i) {
+    struct Queue *q = &queues[i];
+
+    rte_pktmbuf_free_bulk(q->pending, q->pending_count);
+    q->pending_count = 0;
+  }
+
+  if (port_started) {
+    rte_eth_dev_stop(port);
+    rte_eth_dev_close(port);
+  }
+
+  rte_mempool_free(pool);
+
+  if (eal_ready)
+    rte_eal_cleanup();
+}
+
+QueueCountRT
+queue_count()
+{
+  return queue_total;
+}
+
+/**
+ * RSS hash is computed from addresses and ports of the outer header only,
+ * which are always in flow key when flower uses the hash.
+ */
+TupleHashRT
+tuple_hash()
+{
+  return queue_total > 1;
+}
+
+/**
+ * Registers calling thread in EAL, so it gets its own mempool cache.
+ * Capture and processing threads of flower are not EAL threads, without
+ * registration mbufs are allocated and freed directly in the shared ring.
+ * Registration fails harmlessly when EAL has no free lcore.
+ */
+static void
+register_thread()
+{
+  if (rte_lcore_id() == LCORE_ID_ANY)
+    rte_thread_register();
+}
+
+/**
+ * Receives burst of mbufs. Data of the first segment are handed out
+ * directly from mbuf. Ports have no capture timestamps by default, whole
+ * burst gets time of its receipt.
+ */
+static GetPacketsRT
+receive(unsigned int queue, struct Packet *out, struct rte_mbuf **burst,
+    unsigned int max)
+{
+  struct Queue *q = &queues[queue];
+
+  if (!q->registered) {
+    register_thread();
+    q->registered = 1;
+  }
+
+  if (max > MAX_BURST)
+    max = MAX_BURST;
+
+  uint16_t count = rte_eth_rx_burst(port, queue, burst, max);
+  if (!count)
+    return (GetPacketsRT){CAPTURE_TIMEOUT, 0};
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  for (uint16_t i = 0; i < count; ++i) {
+    struct rte_mbuf *mbuf = burst[i];
+
+    out[i] = (struct Packet){
+      rte_pktmbuf_mtod(mbuf, const unsigned char *),
+      mbuf->pkt_len,
+      mbuf->data_len,
+      now.tv_sec,
+      now.tv_nsec / 1000,
+      0,
+      mbuf->ol_flags & RTE_MBUF_F_RX_RSS_HASH ? mbuf->hash.rss : 0,
+      mbuf->ol_flags & RTE_MBUF_F_RX_LRO ? mbuf->tso_segsz : 0
+    };
+  }
+
+  return (GetPacketsRT){CAPTURE_PACKET, count};
+}
+
+/**
+ * Function get packets frees mbufs of the previous burst and receives
+ * a new one, so the burst stays valid until the next call.
+ */
+GetPacketsRT
+get_packets_q(unsigned int queue, struct Packet *out, unsigned int max)
+{
+  struct Queue *q = &queues[queue];
+
+  rte_pktmbuf_free_bulk(q->pending, q->pending_count);
+
+  GetPacketsRT result = receive(queue, out, q->pending, max);
+  q->pending_count = result.count;
+
+  return result;
+}
+
+GetPacketRT
+get_packet_q(unsigned int queue)
+{
+  struct Packet packet;
+
+  GetPacketsRT result = get_packets_q(queue, &packet, 1);
+  if (result.type != CAPTURE_PACKET)
+    return (GetPacketRT){result.type, {}};
+
+  return (GetPacketRT){CAPTURE_PACKET, packet};
+}
+
+/**
+ * Function lease packets hands mbufs out until they are released,
+ * handle is the mbuf itself.
+ */
+GetPacketsRT
+lease_packets_q(unsigned int queue, struct LeasedPacket *out,
+    unsigned int max)
+{
+  struct rte_mbuf *burst[MAX_BURST];
+  struct Packet packets[MAX_BURST];
+
+  GetPacketsRT result = receive(queue, packets, burst, max);
+
+  for (unsigned int i = 0; i < result.count; ++i)
+    out[i] = (struct LeasedPacket){packets[i], burst[i]};
+
+  return result;
+}
+
+GetPacketRT
+get_packet()
+{
+  return get_packet_q(0);
+}
+
+GetPacketsRT
+get_packets(struct Packet *out, unsigned int max)
+{
+  return get_packets_q(0, out, max);
+}
+
+GetPacketsRT
+lease_packets(struct LeasedPacket *out, unsigned int max)
+{
+  return lease_packets_q(0, out, max);
+}
+
+/**
+ * Function release packets frees leased mbufs back to pool. It can be
+ * called from any thread.
+ */
+ReleasePacketsRT
+release_packets(void *const *handles, unsigned int n)
+{
+  static __thread int registered = 0;
+  struct rte_mbuf *burst[MAX_BURST];
+
+  if (!registered) {
+    register_thread();
+    registered = 1;
+  }
+
+  while (n) {
+    unsigned int count = n < MAX_BURST ? n : MAX_BURST;
+
+    for (unsigned int i = 0; i < count; ++i)
+      burst[i] = handles[i];
+
+    rte_pktmbuf_free_bulk(burst, count);
+    handles += count;
+    n -= count;
+  }
+}
+
+/**
+ * Function statistics returns port counters. Packets missed by port and
+ * packets without free mbuf are reported as drops.
+ */
+StatisticsRT
+statistics()
+{
+  struct rte_eth_stats stats;
+
+  if (rte_eth_stats_get(port, &stats))
+    return (StatisticsRT){0, 0};
+
+  unsigned long long drops = stats.imissed + stats.rx_nombuf;
+  return (StatisticsRT){stats.ipackets + drops, drops};
+}
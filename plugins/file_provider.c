@@ -1,10 +1,53 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
 #include <pcap.h>
 
 #include <input.h>
 
+#define ARENA_SIZE (1 << 22)
+
+/* Largest record accepted, the same limit as libpcap has */
+#define MAX_CAPLEN (1 << 18)
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_SWAPPED 0xd4c3b2a1
+#define PCAP_NSEC_MAGIC 0xa1b23c4d
+#define PCAP_NSEC_MAGIC_SWAPPED 0x4d3cb2a1
+
+/* Record header of pcap file as stored on disk */
+struct Record {
+  uint32_t sec;
+  uint32_t frac;
+  uint32_t caplen;
+  uint32_t len;
+};
+
 static pcap_t *handle;
 static char errbuf[PCAP_ERRBUF_SIZE];
 
+static const char *filter = "";
+static unsigned int snaplen = ARENA_SIZE;
+static struct bpf_program program;
+
+/* File of classic pcap capture, whose records are read directly into arena,
+ * NULL if libpcap has to parse the file, e.g. pcapng */
+static FILE *file;
+static int swapped;
+static int nanoseconds;
+
+/* Packets of one batch are read here, since libpcap reuses its buffer */
+static unsigned char arena[ARENA_SIZE];
+
+/* Record header read in the previous batch whose data did not fit into
+ * arena */
+static struct Record pending;
+static int has_pending;
+
+/* Description of the last input error */
+static char error[PCAP_ERRBUF_SIZE];
+
 InfoRT
 info()
 {
@@ -16,6 +59,52 @@ info()
   };
 }
 
+/**
+ * Function configure stores capture options. Packets are longer than snaplen
+ * only if they were captured with larger snaplen, they are truncated here.
+ */
+ConfigureRT
+configure(const struct CaptureOptions *options)
+{
+  static char copy[PCAP_BUF_SIZE];
+
+  if (strlen(options->filter) >= sizeof(copy))
+    return (ConfigureRT){RESULT_ERROR, "Filter is too long"};
+
+  strcpy(copy, options->filter);
+  filter = copy;
+
+  if (options->snaplen && options->snaplen < ARENA_SIZE)
+    snaplen = options->snaplen;
+
+  return (ConfigureRT){RESULT_OK, ""};
+}
+
+/**
+ * Reads magic number of file to find out if it is a classic pcap file,
+ * whose records can be read without libpcap.
+ */
+static int
+classic_pcap(const char *path)
+{
+  uint32_t magic = 0;
+  FILE *f = fopen(path, "rb");
+
+  if (!f)
+    return 0;
+
+  size_t read = fread(&magic, sizeof(magic), 1, f);
+  fclose(f);
+
+  if (read != 1)
+    return 0;
+
+  swapped = magic == PCAP_MAGIC_SWAPPED || magic == PCAP_NSEC_MAGIC_SWAPPED;
+  nanoseconds = magic == PCAP_NSEC_MAGIC || magic == PCAP_NSEC_MAGIC_SWAPPED;
+
+  return swapped || nanoseconds || magic == PCAP_MAGIC;
+}
+
 InitRT
 init(const char *arg)
 {
@@ -25,30 +114,154 @@ init(const char *arg)
     return (InitRT){RESULT_ERROR, errbuf};
   }
 
+  /* Records follow the file header libpcap has already read */
+  if (classic_pcap(arg))
+    file = pcap_file(handle);
+
+  /* Filter is run by libpcap in get_packet and by get_packets itself */
+  if (*filter) {
+    if (pcap_compile(handle, &program, filter, 1, PCAP_NETMASK_UNKNOWN))
+      return (InitRT){RESULT_ERROR, pcap_geterr(handle)};
+
+    if (pcap_setfilter(handle, &program))
+      return (InitRT){RESULT_ERROR, pcap_geterr(handle)};
+  }
+
   return (InitRT){RESULT_OK, ""};
 }
 
 FinalizeRT
 finalize()
 {
+  if (*filter)
+    pcap_freecode(&program);
+
   pcap_close(handle);
 }
 
+/**
+ * Function last error describes why capture ended with CAPTURE_INPUT_ERROR.
+ */
+LastErrorRT
+last_error()
+{
+  return error;
+}
+
 GetPacketRT
 get_packet()
 {
-  struct pcap_pkthdr header;
-  const u_char *data = pcap_next(handle, &header);
+  struct pcap_pkthdr *header;
+  const u_char *data;
+  int status = pcap_next_ex(handle, &header, &data);
 
-  if (data) {
+  if (status == 1) {
     return (GetPacketRT){CAPTURE_PACKET, {
       data,
+      header->len,
+      header->caplen < snaplen ? header->caplen : snaplen,
+      header->ts.tv_sec,
+      header->ts.tv_usec
+    }};
+  }
+
+  if (status == PCAP_ERROR) {
+    snprintf(error, sizeof(error), "%s", pcap_geterr(handle));
+    return (GetPacketRT){CAPTURE_INPUT_ERROR, {}};
+  }
+
+  return (GetPacketRT){CAPTURE_END_OF_INPUT, {}};
+}
+
+static uint32_t
+field(uint32_t value)
+{
+  return swapped ? __builtin_bswap32(value) : value;
+}
+
+/**
+ * Function get packets reads records of classic pcap file directly into
+ * arena, so packet data are copied only once, as libpcap would copy them
+ * into its own buffer. Record that does not fit is read in the next batch.
+ * Other formats are parsed by libpcap, which keeps only one packet in its
+ * buffer, so one packet is returned without copying.
+ */
+GetPacketsRT
+get_packets(struct Packet *out, unsigned int max)
+{
+  unsigned int count = 0;
+  size_t used = 0;
+
+  if (!file) {
+    GetPacketRT result = get_packet();
+
+    if (result.type != CAPTURE_PACKET)
+      return (GetPacketsRT){result.type, 0};
+
+    out[0] = result.packet;
+    return (GetPacketsRT){CAPTURE_PACKET, 1};
+  }
+
+  while (count < max) {
+    struct Record record = pending;
+
+    if (!has_pending) {
+      size_t read = fread(&record, 1, sizeof(record), file);
+
+      if (read == 0 && !ferror(file))
+        break;
+
+      if (read != sizeof(record)) {
+        snprintf(error, sizeof(error), "Truncated record header");
+        return (GetPacketsRT){CAPTURE_INPUT_ERROR, 0};
+      }
+
+      record.sec = field(record.sec);
+      record.frac = field(record.frac);
+      record.caplen = field(record.caplen);
+      record.len = field(record.len);
+    }
+
+    if (record.caplen > MAX_CAPLEN) {
+      snprintf(error, sizeof(error), "Record of %u bytes is too large",
+          record.caplen);
+      return (GetPacketsRT){CAPTURE_INPUT_ERROR, 0};
+    }
+
+    if (used + record.caplen > ARENA_SIZE) {
+      pending = record;
+      has_pending = 1;
+      break;
+    }
+
+    has_pending = 0;
+    if (fread(arena + used, 1, record.caplen, file) != record.caplen) {
+      snprintf(error, sizeof(error), "Truncated record of %u bytes",
+          record.caplen);
+      return (GetPacketsRT){CAPTURE_INPUT_ERROR, 0};
+    }
+
+    struct pcap_pkthdr header = {
+      {record.sec, nanoseconds ? record.frac / 1000 : record.frac},
+      record.caplen,
+      record.len
+    };
+
+    if (*filter && !pcap_offline_filter(&program, &header, arena + used))
+      continue;
+
+    out[count++] = (struct Packet){
+      arena + used,
       header.len,
-      header.caplen,
+      header.caplen < snaplen ? header.caplen : snaplen,
       header.ts.tv_sec,
       header.ts.tv_usec
-    }};
+    };
+    used += header.caplen;
   }
 
-  return (GetPacketRT){CAPTURE_END_OF_INPUT, {}};
+  if (count)
+    return (GetPacketsRT){CAPTURE_PACKET, count};
+
+  return (GetPacketsRT){CAPTURE_END_OF_INPUT, 0};
 }
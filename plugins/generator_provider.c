@@ -0,0 +1,589 @@
+#include <arpa/inet.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <input.h>
+
+#define ARG_SIZE 4096
+#define MAX_BATCH 256
+#define MAX_FRAME 9216
+#define USEC_PER_SEC 1000000
+
+#define ETH_HEADER_SIZE 14
+#define VLAN_HEADER_SIZE 4
+#define IPV4_HEADER_SIZE 20
+#define IPV6_HEADER_SIZE 40
+#define TCP_HEADER_SIZE 20
+#define UDP_HEADER_SIZE 8
+#define VXLAN_HEADER_SIZE 8
+#define GRE_HEADER_SIZE 4
+
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_IPV6 0x86DD
+#define ETHERTYPE_VLAN 0x8100
+#define PROTO_TCP 6
+#define PROTO_UDP 17
+#define PROTO_GRE 47
+#define VXLAN_PORT 4789
+
+enum Tunnel {
+  TUNNEL_NONE,
+  TUNNEL_VXLAN,
+  TUNNEL_GRE
+};
+
+/**
+ * Traffic profile set by plugin argument. Percentages select the share
+ * of flows with given property, so every flow keeps its encapsulation.
+ */
+static struct {
+  uint64_t flows;
+  double zipf;
+  unsigned int min_size;
+  unsigned int max_size;
+  unsigned int ipv6;
+  unsigned int udp;
+  unsigned int vlan;
+  unsigned int vxlan;
+  unsigned int gre;
+  double churn;
+  uint64_t count;
+  uint64_t rate;
+  uint64_t seed;
+  unsigned int queues;
+} config = {1000, 0, 64, 1500, 0, 50, 0, 0, 0, 0, 0, USEC_PER_SEC, 1, 1};
+
+/**
+ * Independent generator of one queue. Every queue owns a disjoint range
+ * of flow slots, so a flow is never split between queues.
+ */
+struct Queue {
+  uint64_t state;
+  uint64_t generated;
+  uint64_t count;
+  uint64_t first_slot;
+  uint64_t flows;
+
+  /* Constants of Zipf rejection-inversion sampling */
+  double zipf_x1;
+  double zipf_n;
+  double zipf_s;
+
+  unsigned char (*arena)[MAX_FRAME];
+};
+
+/**
+ * Properties of one flow derived from its slot and generation.
+ */
+struct Flow {
+  uint64_t hash;
+  uint32_t slot;
+  int ipv6;
+  int udp;
+  int vlan;
+  enum Tunnel tunnel;
+};
+
+/* Flow in slot is replaced by a new one by bumping its generation */
+static uint32_t *generations;
+
+static struct Queue *queues;
+static uint64_t start_usec;
+
+static char errbuf[256];
+
+InfoRT
+info()
+{
+  return (InfoRT){
+    "GeneratorInput",
+    INPUT_PLUGIN,
+    "Input of synthetic traffic generated in memory\n"
+    "The argument is a comma separated list of key=value options:\n"
+    "flows=N number of concurrent flows, zipf=S popularity skew of flows,\n"
+    "0 is uniform, size=MIN-MAX frame size, ipv6=, udp=, vlan=, vxlan=,\n"
+    "gre= percentage of flows with the property, churn=P probability\n"
+    "that a packet replaces random flow by a new one, count=N packets\n"
+    "to generate, 0 is unlimited, rate=PPS used for packet timestamps,\n"
+    "seed=N and queues=N to generate in parallel. Checksums are not\n"
+    "computed\n"
+  };
+}
+
+/* https://prng.di.unimi.it/splitmix64.c */
+static uint64_t
+mix(uint64_t x)
+{
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+static uint64_t
+next_random(struct Queue *queue)
+{
+  queue->state += 0x9E3779B97F4A7C15ull;
+  return mix(queue->state);
+}
+
+static double
+next_double(struct Queue *queue)
+{
+  return (next_random(queue) >> 11) * 0x1.0p-53;
+}
+
+/* Helpers keep Zipf integrals numerically stable for exponents near 1 */
+static double
+helper1(double x)
+{
+  return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x / 2;
+}
+
+static double
+helper2(double x)
+{
+  return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x / 2;
+}
+
+static double
+zipf_h(double x)
+{
+  return exp(-config.zipf * log(x));
+}
+
+static double
+zipf_integral(double x)
+{
+  double log_x = log(x);
+  return helper2((1 - config.zipf) * log_x) * log_x;
+}
+
+static double
+zipf_integral_inverse(double x)
+{
+  double t = x * (1 - config.zipf);
+  if (t < -1)
+    t = -1;
+  return exp(helper1(t) * x);
+}
+
+/**
+ * Draws flow slot. Zipf distribution is sampled by rejection-inversion
+ * of Hormann and Derflinger, which needs no table even for 10M+ flows.
+ */
+static uint64_t
+next_slot(struct Queue *queue)
+{
+  if (config.zipf <= 0)
+    return queue->first_slot + next_random(queue) % queue->flows;
+
+  for (;;) {
+    double u = queue->zipf_n
+      + next_double(queue) * (queue->zipf_x1 - queue->zipf_n);
+    double x = zipf_integral_inverse(u);
+    uint64_t k = x + 0.5;
+
+    if (k < 1)
+      k = 1;
+    else if (k > queue->flows)
+      k = queue->flows;
+
+    if (k - x <= queue->zipf_s || u >= zipf_integral(k + 0.5) - zipf_h(k))
+      return queue->first_slot + k - 1;
+  }
+}
+
+static int
+parse_size(char *value)
+{
+  char *end;
+  config.min_size = config.max_size = strtoul(value, &end, 0);
+
+  if (*end == '-')
+    config.max_size = strtoul(end + 1, &end, 0);
+
+  return !*end && config.min_size <= config.max_size
+    && config.max_size <= MAX_FRAME;
+}
+
+static int
+parse_arg(const char *arg)
+{
+  static char copy[ARG_SIZE];
+  char *save;
+
+  strncpy(copy, arg, sizeof(copy) - 1);
+
+  for (char *token = strtok_r(copy, ",", &save); token;
+      token = strtok_r(NULL, ",", &save)) {
+    char *value = strchr(token, '=');
+    if (!value)
+      return 0;
+    *value++ = '\0';
+
+    if (!strcmp(token, "flows"))
+      config.flows = strtoull(value, NULL, 0);
+    else if (!strcmp(token, "zipf"))
+      config.zipf = strtod(value, NULL);
+    else if (!strcmp(token, "size")) {
+      if (!parse_size(value))
+        return 0;
+    } else if (!strcmp(token, "ipv6"))
+      config.ipv6 = strtoul(value, NULL, 0);
+    else if (!strcmp(token, "udp"))
+      config.udp = strtoul(value, NULL, 0);
+    else if (!strcmp(token, "vlan"))
+      config.vlan = strtoul(value, NULL, 0);
+    else if (!strcmp(token, "vxlan"))
+      config.vxlan = strtoul(value, NULL, 0);
+    else if (!strcmp(token, "gre"))
+      config.gre = strtoul(value, NULL, 0);
+    else if (!strcmp(token, "churn"))
+      config.churn = strtod(value, NULL);
+    else if (!strcmp(token, "count"))
+      config.count = strtoull(value, NULL, 0);
+    else if (!strcmp(token, "rate"))
+      config.rate = strtoull(value, NULL, 0);
+    else if (!strcmp(token, "seed"))
+      config.seed = strtoull(value, NULL, 0);
+    else if (!strcmp(token, "queues"))
+      config.queues = strtoul(value, NULL, 0);
+    else
+      return 0;
+  }
+
+  return config.flows && config.flows <= UINT32_MAX && config.rate
+    && config.queues && config.queues <= config.flows
+    && config.vxlan + config.gre <= 100;
+}
+
+InitRT
+init(const char *arg)
+{
+  if (!parse_arg(arg)) {
+    snprintf(errbuf, sizeof(errbuf), "Invalid generator options: %s", arg);
+    return (InitRT){RESULT_ERROR, errbuf};
+  }
+
+  generations = calloc(config.flows, sizeof(*generations));
+  if (!generations)
+    return (InitRT){RESULT_ERROR, "Could not allocate flow table"};
+
+  queues = calloc(config.queues, sizeof(*queues));
+  if (!queues)
+    return (InitRT){RESULT_ERROR, "Could not allocate queues"};
+
+  /* Flows and packets are split evenly, the first queues take the rest */
+  for (unsigned int i = 0; i < config.queues; ++i) {
+    struct Queue *queue = &queues[i];
+
+    queue->state = mix(config.seed + i);
+    queue->flows = config.flows / config.queues
+      + (i < config.flows % config.queues);
+    queue->first_slot = i ? queues[i - 1].first_slot + queues[i - 1].flows : 0;
+    queue->count = config.count / config.queues
+      + (i < config.count % config.queues);
+
+    if (config.zipf > 0) {
+      queue->zipf_x1 = zipf_integral(1.5) - 1;
+      queue->zipf_n = zipf_integral(queue->flows + 0.5);
+      queue->zipf_s = 2
+        - zipf_integral_inverse(zipf_integral(2.5) - zipf_h(2));
+    }
+
+    queue->arena = malloc(MAX_BATCH * sizeof(*queue->arena));
+    if (!queue->arena)
+      return (InitRT){RESULT_ERROR, "Could not allocate frame arena"};
+  }
+
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  start_usec = (uint64_t)now.tv_sec * USEC_PER_SEC + now.tv_usec;
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+FinalizeRT
+finalize()
+{
+  for (unsigned int i = 0; queues && i < config.queues; ++i)
+    free(queues[i].arena);
+
+  free(queues);
+  free(generations);
+}
+
+QueueCountRT
+queue_count()
+{
+  return config.queues;
+}
+
+static struct Flow
+make_flow(uint64_t slot)
+{
+  uint64_t hash = mix(config.seed ^ (slot << 32 | generations[slot]));
+  unsigned int tunnel = (hash >> 24) % 100;
+
+  return (struct Flow){
+    hash,
+    slot,
+    (hash % 100) < config.ipv6,
+    ((hash >> 8) % 100) < config.udp,
+    ((hash >> 16) % 100) < config.vlan,
+    tunnel < config.vxlan ? TUNNEL_VXLAN
+      : tunnel < config.vxlan + config.gre ? TUNNEL_GRE : TUNNEL_NONE
+  };
+}
+
+static unsigned char *
+put16(unsigned char *data, uint16_t value)
+{
+  value = htons(value);
+  memcpy(data, &value, sizeof(value));
+  return data + sizeof(value);
+}
+
+static unsigned char *
+put32(unsigned char *data, uint32_t value)
+{
+  value = htonl(value);
+  memcpy(data, &value, sizeof(value));
+  return data + sizeof(value);
+}
+
+static unsigned char *
+put_ethernet(unsigned char *data, uint16_t type, uint16_t vlan)
+{
+  static const unsigned char macs[] = {
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x02,
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x01
+  };
+
+  memcpy(data, macs, sizeof(macs));
+  data += sizeof(macs);
+
+  if (vlan) {
+    data = put16(data, ETHERTYPE_VLAN);
+    data = put16(data, vlan);
+  }
+
+  return put16(data, type);
+}
+
+static unsigned char *
+put_ipv4(unsigned char *data, uint32_t src, uint32_t dst, uint8_t proto,
+    uint16_t len)
+{
+  data[0] = 0x45;
+  data[1] = 0;
+  put16(data + 2, len);
+  memset(data + 4, 0, 4);
+  data[8] = 64;
+  data[9] = proto;
+  put16(data + 10, 0);
+  put32(data + 12, src);
+  put32(data + 16, dst);
+
+  return data + IPV4_HEADER_SIZE;
+}
+
+static unsigned char *
+put_ipv6(unsigned char *data, const struct Flow *flow, uint8_t proto,
+    uint16_t payload)
+{
+  put32(data, 0x60000000);
+  put16(data + 4, payload);
+  data[6] = proto;
+  data[7] = 64;
+
+  /* 2001:db8::/32 addresses, source is unique for the slot */
+  put32(data + 8, 0x20010DB8);
+  put32(data + 12, 0);
+  put32(data + 16, 0);
+  put32(data + 20, flow->slot);
+  put32(data + 24, 0x20010DB8);
+  put32(data + 28, 1);
+  put32(data + 32, flow->hash >> 32);
+  put32(data + 36, flow->hash);
+
+  return data + IPV6_HEADER_SIZE;
+}
+
+/**
+ * Builds one frame of flow with total size close to requested. Frames
+ * are never shorter than their headers. Returns the frame length.
+ */
+static unsigned int
+build_frame(unsigned char *data, const struct Flow *flow, unsigned int size,
+    uint32_t seq)
+{
+  unsigned int ip_size = flow->ipv6 ? IPV6_HEADER_SIZE : IPV4_HEADER_SIZE;
+  unsigned int l4_size = flow->udp ? UDP_HEADER_SIZE : TCP_HEADER_SIZE;
+  unsigned int outer = ETH_HEADER_SIZE + (flow->vlan ? VLAN_HEADER_SIZE : 0);
+
+  if (flow->tunnel == TUNNEL_VXLAN)
+    outer += IPV4_HEADER_SIZE + UDP_HEADER_SIZE + VXLAN_HEADER_SIZE
+      + ETH_HEADER_SIZE;
+  else if (flow->tunnel == TUNNEL_GRE)
+    outer += IPV4_HEADER_SIZE + GRE_HEADER_SIZE;
+
+  unsigned int headers = outer + ip_size + l4_size;
+  unsigned int payload = size > headers ? size - headers : 0;
+  unsigned int inner = ip_size + l4_size + payload;
+  uint16_t type = flow->ipv6 ? ETHERTYPE_IPV6 : ETHERTYPE_IPV4;
+  uint16_t vlan = flow->vlan ? 1 + (flow->hash >> 40) % 4094 : 0;
+  unsigned char *pos = data;
+
+  /* Tunnel endpoints are shared by all flows, like on a real overlay */
+  switch (flow->tunnel) {
+    case TUNNEL_VXLAN: {
+      unsigned int udp_len = UDP_HEADER_SIZE + VXLAN_HEADER_SIZE
+        + ETH_HEADER_SIZE + inner;
+
+      pos = put_ethernet(pos, ETHERTYPE_IPV4, vlan);
+      pos = put_ipv4(pos, 0xC0000201, 0xC0000202, PROTO_UDP,
+          IPV4_HEADER_SIZE + udp_len);
+      pos = put16(pos, 49152 + flow->hash % 16384);
+      pos = put16(pos, VXLAN_PORT);
+      pos = put16(pos, udp_len);
+      pos = put16(pos, 0);
+      pos = put32(pos, 0x08000000);
+      pos = put32(pos, (uint32_t)(flow->hash >> 48) << 8);
+      pos = put_ethernet(pos, type, 0);
+      break;
+    }
+
+    case TUNNEL_GRE:
+      pos = put_ethernet(pos, ETHERTYPE_IPV4, vlan);
+      pos = put_ipv4(pos, 0xC0000201, 0xC0000202, PROTO_GRE,
+          IPV4_HEADER_SIZE + GRE_HEADER_SIZE + inner);
+      pos = put16(pos, 0);
+      pos = put16(pos, type);
+      break;
+
+    default:
+      pos = put_ethernet(pos, type, vlan);
+      break;
+  }
+
+  uint8_t proto = flow->udp ? PROTO_UDP : PROTO_TCP;
+  if (flow->ipv6)
+    pos = put_ipv6(pos, flow, proto, l4_size + payload);
+  else
+    pos = put_ipv4(pos, 0x0A000000 | (flow->slot & 0xFFFFFF),
+        0xAC100000 | ((flow->hash >> 32) & 0xFFFFF), proto, inner);
+
+  pos = put16(pos, 1024 + (flow->hash >> 16) % 64512);
+  pos = put16(pos, 1 + (flow->hash >> 48) % 1024);
+
+  if (flow->udp) {
+    pos = put16(pos, l4_size + payload);
+    pos = put16(pos, 0);
+  } else {
+    pos = put32(pos, seq);
+    pos = put32(pos, 0);
+    pos = put16(pos, 0x5018);
+    pos = put16(pos, 0xFFFF);
+    pos = put32(pos, 0);
+  }
+
+  /* Payload keeps whatever the arena holds, its content does not matter */
+  return headers + payload;
+}
+
+static struct Packet
+next_packet(struct Queue *queue, unsigned char *data)
+{
+  if (config.churn > 0 && next_double(queue) < config.churn)
+    ++generations[queue->first_slot + next_random(queue) % queue->flows];
+
+  struct Flow flow = make_flow(next_slot(queue));
+  unsigned int size = config.min_size
+    + next_random(queue) % (config.max_size - config.min_size + 1);
+  unsigned int len = build_frame(data, &flow, size, queue->generated);
+
+  /* Queues share the rate, so their timestamps interleave */
+  uint64_t ts = start_usec
+    + queue->generated * config.queues * USEC_PER_SEC / config.rate;
+
+  ++queue->generated;
+
+  /* Flow hash as provided by NIC, never zero. It follows generated flow
+   * rather than its 5-tuple, so it is not declared by tuple_hash */
+  return (struct Packet){
+    data,
+    len,
+    len,
+    ts / USEC_PER_SEC,
+    ts % USEC_PER_SEC,
+    0,
+    (uint32_t)(flow.hash ^ flow.slot) | 1
+  };
+}
+
+static int
+exhausted(const struct Queue *queue)
+{
+  return config.count && queue->generated >= queue->count;
+}
+
+GetPacketRT
+get_packet_q(unsigned int id)
+{
+  struct Queue *queue = &queues[id];
+
+  if (exhausted(queue))
+    return (GetPacketRT){CAPTURE_END_OF_INPUT, {}};
+
+  return (GetPacketRT){CAPTURE_PACKET, next_packet(queue, queue->arena[0])};
+}
+
+/**
+ * Function get packets builds up to max frames into the arena of queue,
+ * frames stay valid until the next call on the same queue.
+ */
+GetPacketsRT
+get_packets_q(unsigned int id, struct Packet *out, unsigned int max)
+{
+  struct Queue *queue = &queues[id];
+  unsigned int count = 0;
+
+  while (count < max && count < MAX_BATCH && !exhausted(queue)) {
+    out[count] = next_packet(queue, queue->arena[count]);
+    ++count;
+  }
+
+  if (count)
+    return (GetPacketsRT){CAPTURE_PACKET, count};
+
+  return (GetPacketsRT){CAPTURE_END_OF_INPUT, 0};
+}
+
+GetPacketRT
+get_packet()
+{
+  return get_packet_q(0);
+}
+
+GetPacketsRT
+get_packets(struct Packet *out, unsigned int max)
+{
+  return get_packets_q(0, out, max);
+}
+
+StatisticsRT
+statistics()
+{
+  unsigned long long generated = 0;
+
+  for (unsigned int i = 0; i < config.queues; ++i)
+    generated += queues[i].generated;
+
+  return (StatisticsRT){generated, 0};
+}
@@ -1,10 +1,27 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include <pcap.h>
 
 #include <input.h>
 
+#define SNAPLEN BUFSIZ
+#define MAX_BATCH 256
+
 static pcap_t *handle;
 static char errbuf[PCAP_ERRBUF_SIZE];
 
+static const char *filter = "";
+static unsigned int snaplen = SNAPLEN;
+
+/* Packets of one batch are copied here, since libpcap reuses its buffer */
+static unsigned char *arena;
+
+struct Batch {
+  struct Packet *out;
+  unsigned int count;
+};
+
 /**
  * Function info must return PluginInfo struct.
  */
@@ -19,19 +36,59 @@ info()
   };
 }
 
+/**
+ * Function configure stores capture options, which are applied when
+ * the capture device is opened.
+ */
+ConfigureRT
+configure(const struct CaptureOptions *options)
+{
+  static char copy[PCAP_BUF_SIZE];
+
+  if (strlen(options->filter) >= sizeof(copy))
+    return (ConfigureRT){RESULT_ERROR, "Filter is too long"};
+
+  strcpy(copy, options->filter);
+  filter = copy;
+
+  if (options->snaplen)
+    snaplen = options->snaplen;
+
+  return (ConfigureRT){RESULT_OK, ""};
+}
+
 /**
  * Function init initializes plugin. Plugin should open capture device
- * in this function.
+ * in this function. Filter is compiled to kernel socket filter, so
+ * packets not matching it are dropped before they are copied.
  */
 InitRT
 init(const char *arg)
 {
-  handle = pcap_open_live(arg, BUFSIZ, 1, 1000, errbuf);
+  handle = pcap_open_live(arg, snaplen, 1, 1000, errbuf);
 
   if (!handle) {
     return (InitRT){RESULT_ERROR, errbuf};
   }
 
+  arena = malloc((size_t)MAX_BATCH * snaplen);
+  if (!arena) {
+    return (InitRT){RESULT_ERROR, "Cannot allocate packet arena"};
+  }
+
+  if (*filter) {
+    struct bpf_program program;
+
+    if (pcap_compile(handle, &program, filter, 1, PCAP_NETMASK_UNKNOWN))
+      return (InitRT){RESULT_ERROR, pcap_geterr(handle)};
+
+    int status = pcap_setfilter(handle, &program);
+    pcap_freecode(&program);
+
+    if (status)
+      return (InitRT){RESULT_ERROR, pcap_geterr(handle)};
+  }
+
   return (InitRT){RESULT_OK, ""};
 }
 
@@ -42,7 +99,10 @@ init(const char *arg)
 FinalizeRT
 finalize()
 {
-  pcap_close(handle);
+  if (handle)
+    pcap_close(handle);
+
+  free(arena);
 }
 
 /**
@@ -80,3 +140,42 @@ get_packet()
   /* Else return end of input, in interface mode this should not happen */
   return (GetPacketRT){CAPTURE_END_OF_INPUT, {}};
 }
+
+static void
+copy_packet(u_char *user, const struct pcap_pkthdr *header, const u_char *data)
+{
+  struct Batch *batch = (struct Batch *)user;
+  unsigned char *slot = arena + (size_t)batch->count * snaplen;
+  unsigned int caplen = header->caplen < snaplen ? header->caplen : snaplen;
+
+  memcpy(slot, data, caplen);
+  batch->out[batch->count++] = (struct Packet){
+    slot,
+    header->len,
+    caplen,
+    header->ts.tv_sec,
+    header->ts.tv_usec
+  };
+}
+
+/**
+ * Function get packets captures up to max packets in one dispatch.
+ */
+GetPacketsRT
+get_packets(struct Packet *out, unsigned int max)
+{
+  struct Batch batch = {out, 0};
+  int status = pcap_dispatch(handle, max < MAX_BATCH ? max : MAX_BATCH,
+      copy_packet, (u_char *)&batch);
+
+  if (batch.count)
+    return (GetPacketsRT){CAPTURE_PACKET, batch.count};
+
+  if (status == 0)
+    return (GetPacketsRT){CAPTURE_TIMEOUT, 0};
+
+  if (status == PCAP_ERROR)
+    return (GetPacketsRT){CAPTURE_INPUT_ERROR, 0};
+
+  return (GetPacketsRT){CAPTURE_END_OF_INPUT, 0};
+}
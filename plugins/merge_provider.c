@@ -0,0 +1,309 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <input.h>
+
+#define MAGIC_USEC 0xa1b2c3d4
+#define MAGIC_NSEC 0xa1b23c4d
+#define GLOBAL_HEADER_SIZE 24
+#define RECORD_HEADER_SIZE 16
+
+/* Window each file is read ahead by, so all files are read in parallel */
+#define READAHEAD_SIZE (16 << 20)
+
+#define USEC_PER_SEC 1000000
+#define ARG_SIZE 4096
+
+/**
+ * One merged capture file with its next record.
+ */
+struct Source {
+  const unsigned char *map;
+  size_t size;
+  size_t offset;
+  size_t prefetched;
+  int swapped;
+  int nanoseconds;
+  uint64_t timestamp;
+  unsigned int index;
+};
+
+static struct Source *sources;
+static unsigned int source_count;
+
+/* Min heap of sources ordered by timestamp of their next record */
+static struct Source **heap;
+static unsigned int heap_size;
+
+static char errbuf[256];
+
+InfoRT
+info()
+{
+  return (InfoRT){
+    "MergeInput",
+    INPUT_PLUGIN,
+    "Input from multiple pcap files merged by packet timestamps\n"
+    "The argument is a comma separated list of files or glob patterns,\n"
+    "e.g. 'tap_a.pcap,tap_b.pcap'. Packets of all files are returned as\n"
+    "one stream ordered by time\n"
+  };
+}
+
+static uint32_t
+read32(const struct Source *source, const unsigned char *data)
+{
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return source->swapped ? __builtin_bswap32(value) : value;
+}
+
+static int
+earlier(const struct Source *first, const struct Source *second)
+{
+  if (first->timestamp != second->timestamp)
+    return first->timestamp < second->timestamp;
+
+  return first->index < second->index;
+}
+
+static void
+sift_down(unsigned int i)
+{
+  for (;;) {
+    unsigned int min = i;
+    unsigned int left = 2 * i + 1;
+    unsigned int right = left + 1;
+
+    if (left < heap_size && earlier(heap[left], heap[min]))
+      min = left;
+    if (right < heap_size && earlier(heap[right], heap[min]))
+      min = right;
+    if (min == i)
+      return;
+
+    struct Source *tmp = heap[i];
+    heap[i] = heap[min];
+    heap[min] = tmp;
+    i = min;
+  }
+}
+
+/**
+ * Loads timestamp of the next record of source. Returns zero if the
+ * source has no complete record left.
+ */
+static int
+load_record(struct Source *source)
+{
+  size_t left = source->size - source->offset;
+  const unsigned char *data = source->map + source->offset;
+
+  if (left < RECORD_HEADER_SIZE
+      || left - RECORD_HEADER_SIZE < read32(source, data + 8))
+    return 0;
+
+  uint32_t frac = read32(source, data + 4);
+  source->timestamp = (uint64_t)read32(source, data) * USEC_PER_SEC
+    + (source->nanoseconds ? frac / 1000 : frac);
+
+  /* Keep the window ahead of the cursor in page cache */
+  if (source->offset >= source->prefetched) {
+    size_t start = source->offset & ~(size_t)(getpagesize() - 1);
+    size_t len = source->size - start < READAHEAD_SIZE
+      ? source->size - start : READAHEAD_SIZE;
+
+    madvise((void *)(source->map + start), len, MADV_WILLNEED);
+    source->prefetched = start + len;
+  }
+
+  return 1;
+}
+
+static int
+open_source(const char *path, struct Source *source)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+
+  struct stat st;
+  if (fstat(fd, &st) || (size_t)st.st_size < GLOBAL_HEADER_SIZE) {
+    close(fd);
+    return 0;
+  }
+  source->size = st.st_size;
+
+  source->map = mmap(NULL, source->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (source->map == MAP_FAILED)
+    return 0;
+
+  madvise((void *)source->map, source->size, MADV_SEQUENTIAL);
+
+  uint32_t magic;
+  memcpy(&magic, source->map, sizeof(magic));
+  source->swapped = magic == __builtin_bswap32(MAGIC_USEC)
+    || magic == __builtin_bswap32(MAGIC_NSEC);
+  magic = read32(source, source->map);
+
+  if (magic != MAGIC_USEC && magic != MAGIC_NSEC)
+    return 0;
+
+  source->nanoseconds = magic == MAGIC_NSEC;
+  source->offset = GLOBAL_HEADER_SIZE;
+
+  return 1;
+}
+
+InitRT
+init(const char *arg)
+{
+  static char copy[ARG_SIZE];
+  glob_t paths;
+  char *save;
+  int flags = 0;
+
+  strncpy(copy, arg, sizeof(copy) - 1);
+
+  for (char *token = strtok_r(copy, ",", &save); token;
+      token = strtok_r(NULL, ",", &save)) {
+    if (glob(token, flags | GLOB_NOCHECK, NULL, &paths)) {
+      if (flags)
+        globfree(&paths);
+      return (InitRT){RESULT_ERROR, "Could not list files"};
+    }
+    flags = GLOB_APPEND;
+  }
+
+  if (!flags)
+    return (InitRT){RESULT_ERROR, "No files given"};
+
+  sources = calloc(paths.gl_pathc, sizeof(*sources));
+  heap = calloc(paths.gl_pathc, sizeof(*heap));
+  if (!sources || !heap) {
+    globfree(&paths);
+    return (InitRT){RESULT_ERROR, "Could not allocate sources"};
+  }
+
+  for (size_t i = 0; i < paths.gl_pathc; ++i) {
+    struct Source *source = &sources[source_count++];
+    source->index = i;
+
+    errno = 0;
+    if (!open_source(paths.gl_pathv[i], source)) {
+      snprintf(errbuf, sizeof(errbuf), "%s: %s", paths.gl_pathv[i],
+          errno ? strerror(errno) : "Unknown pcap magic number");
+      globfree(&paths);
+      return (InitRT){RESULT_ERROR, errbuf};
+    }
+
+    if (load_record(source))
+      heap[heap_size++] = source;
+  }
+  globfree(&paths);
+
+  for (unsigned int i = heap_size / 2; i-- > 0;)
+    sift_down(i);
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+FinalizeRT
+finalize()
+{
+  for (unsigned int i = 0; i < source_count; ++i) {
+    if (sources[i].map && sources[i].map != MAP_FAILED)
+      munmap((void *)sources[i].map, sources[i].size);
+  }
+
+  free(sources);
+  free(heap);
+}
+
+/**
+ * Takes record of the earliest source and restores heap order.
+ */
+static struct Packet
+take_record()
+{
+  struct Source *source = heap[0];
+  const unsigned char *data = source->map + source->offset;
+  uint32_t caplen = read32(source, data + 8);
+  uint32_t frac = read32(source, data + 4);
+
+  struct Packet packet = {
+    data + RECORD_HEADER_SIZE,
+    read32(source, data + 12),
+    caplen,
+    read32(source, data),
+    source->nanoseconds ? frac / 1000 : frac,
+    0
+  };
+
+  source->offset += RECORD_HEADER_SIZE + caplen;
+  if (!load_record(source))
+    heap[0] = heap[--heap_size];
+  sift_down(0);
+
+  return packet;
+}
+
+GetPacketRT
+get_packet()
+{
+  if (!heap_size)
+    return (GetPacketRT){CAPTURE_END_OF_INPUT, {}};
+
+  return (GetPacketRT){CAPTURE_PACKET, take_record()};
+}
+
+GetPacketsRT
+get_packets(struct Packet *out, unsigned int max)
+{
+  unsigned int count = 0;
+
+  while (count < max && heap_size)
+    out[count++] = take_record();
+
+  if (count)
+    return (GetPacketsRT){CAPTURE_PACKET, count};
+
+  return (GetPacketsRT){CAPTURE_END_OF_INPUT, 0};
+}
+
+/**
+ * Function lease packets hands out pointers into the mappings, which
+ * stay valid until finalize, so releasing packets is a no-op.
+ */
+GetPacketsRT
+lease_packets(struct LeasedPacket *out, unsigned int max)
+{
+  unsigned int count = 0;
+
+  while (count < max && heap_size) {
+    out[count].packet = take_record();
+    out[count].handle = (void *)sources;
+    ++count;
+  }
+
+  if (count)
+    return (GetPacketsRT){CAPTURE_PACKET, count};
+
+  return (GetPacketsRT){CAPTURE_END_OF_INPUT, 0};
+}
+
+ReleasePacketsRT
+release_packets(void *const *handles, unsigned int n)
+{
+  (void)handles;
+  (void)n;
+}
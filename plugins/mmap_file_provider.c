@@ -0,0 +1,404 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <input.h>
+
+#define MAGIC_USEC 0xa1b2c3d4
+#define MAGIC_NSEC 0xa1b23c4d
+#define GLOBAL_HEADER_SIZE 24
+#define RECORD_HEADER_SIZE 16
+#define ARG_SIZE 4096
+
+/**
+ * Time index is stored next to the pcap file with suffix .idx. It starts
+ * with IndexHeader followed by count IndexEntry structures in host byte
+ * order. Entry is written for the first record of every second, seconds
+ * are taken as running maximum, so entries are monotonic even if records
+ * are not. Index is valid only for the file size and mtime it was built for.
+ */
+#define INDEX_SUFFIX ".idx"
+#define INDEX_MAGIC "FLWRIDX1"
+
+struct IndexHeader {
+  char magic[8];
+  uint64_t size;
+  int64_t mtime;
+  uint64_t count;
+};
+
+struct IndexEntry {
+  uint64_t sec;
+  uint64_t offset;
+};
+
+struct RecordHeader {
+  uint32_t sec;
+  uint32_t frac;
+  uint32_t caplen;
+  uint32_t len;
+};
+
+static const unsigned char *map = MAP_FAILED;
+static size_t size;
+static size_t offset;
+static int swapped;
+static int nanoseconds;
+
+/* Time window of returned records, end is exclusive */
+static uint64_t window_start;
+static uint64_t window_end = UINT64_MAX;
+
+static char errbuf[256];
+
+InfoRT
+info()
+{
+  return (InfoRT){
+    "MmapFileInput",
+    INPUT_PLUGIN,
+    "Input from file in pcap format using memory mapping\n"
+    "The argument is a path to the pcap file, both microsecond and\n"
+    "nanosecond timestamp precision is supported. Path may be followed\n"
+    "by comma separated time window in UNIX seconds, e.g.\n"
+    "dump.pcap,start=1600000000,end=1600000600. Window is located using\n"
+    "time index stored next to the file, built on the first use\n"
+  };
+}
+
+static InitRT
+error(const char *msg)
+{
+  snprintf(errbuf, sizeof(errbuf), "%s: %s", msg, strerror(errno));
+  return (InitRT){RESULT_ERROR, errbuf};
+}
+
+static uint32_t
+read32(const unsigned char *data)
+{
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return swapped ? __builtin_bswap32(value) : value;
+}
+
+/**
+ * Parses plugin argument. The first comma separated token is file
+ * path, following tokens are key=value options.
+ */
+static const char *
+parse_arg(const char *arg)
+{
+  static char copy[ARG_SIZE];
+  char *save;
+
+  strncpy(copy, arg, sizeof(copy) - 1);
+
+  char *path = strtok_r(copy, ",", &save);
+  char *token;
+
+  while ((token = strtok_r(NULL, ",", &save))) {
+    char *value = strchr(token, '=');
+    if (!value)
+      return NULL;
+    *value++ = '\0';
+
+    if (!strcmp(token, "start"))
+      window_start = strtoull(value, NULL, 0);
+    else if (!strcmp(token, "end"))
+      window_end = strtoull(value, NULL, 0);
+    else
+      return NULL;
+  }
+
+  return path;
+}
+
+/**
+ * Builds index by walking record headers of the whole file. Index
+ * is written atomically, failure to write it is not fatal.
+ */
+static struct IndexEntry *
+build_index(const char *path, const struct stat *st, uint64_t *count)
+{
+  struct IndexEntry *entries = NULL;
+  uint64_t capacity = 0;
+  uint64_t last = 0;
+
+  *count = 0;
+
+  for (size_t pos = GLOBAL_HEADER_SIZE; size - pos >= RECORD_HEADER_SIZE;) {
+    uint64_t sec = read32(map + pos);
+    uint32_t caplen = read32(map + pos + 8);
+
+    if (size - pos - RECORD_HEADER_SIZE < caplen)
+      break;
+
+    if (!*count || sec > last) {
+      if (*count == capacity) {
+        capacity = capacity ? capacity * 2 : 1024;
+        struct IndexEntry *resized = realloc(entries,
+            capacity * sizeof(*entries));
+
+        if (!resized) {
+          free(entries);
+          return NULL;
+        }
+        entries = resized;
+      }
+
+      entries[(*count)++] = (struct IndexEntry){sec, pos};
+      last = sec;
+    }
+
+    pos += RECORD_HEADER_SIZE + caplen;
+  }
+
+  char tmp[PATH_MAX];
+  char dst[PATH_MAX];
+  snprintf(tmp, sizeof(tmp), "%s" INDEX_SUFFIX ".tmp", path);
+  snprintf(dst, sizeof(dst), "%s" INDEX_SUFFIX, path);
+
+  FILE *file = fopen(tmp, "wb");
+  if (file) {
+    struct IndexHeader header = {INDEX_MAGIC, size, st->st_mtime, *count};
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1
+      && fwrite(entries, sizeof(*entries), *count, file) == *count;
+
+    if (!fclose(file) && ok)
+      rename(tmp, dst);
+    else
+      unlink(tmp);
+  }
+
+  return entries;
+}
+
+/**
+ * Loads index of file if it exists and matches the file.
+ */
+static struct IndexEntry *
+load_index(const char *path, const struct stat *st, uint64_t *count)
+{
+  char name[PATH_MAX];
+  snprintf(name, sizeof(name), "%s" INDEX_SUFFIX, path);
+
+  FILE *file = fopen(name, "rb");
+  if (!file)
+    return NULL;
+
+  struct IndexHeader header;
+  struct IndexEntry *entries = NULL;
+
+  if (fread(&header, sizeof(header), 1, file) == 1
+      && !memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic))
+      && header.size == size && header.mtime == st->st_mtime
+      && header.count <= size / RECORD_HEADER_SIZE
+      && (entries = malloc(header.count * sizeof(*entries)))
+      && fread(entries, sizeof(*entries), header.count, file) != header.count) {
+    free(entries);
+    entries = NULL;
+  }
+  fclose(file);
+
+  *count = header.count;
+  return entries;
+}
+
+/**
+ * Moves offset to the first record that may belong to the window.
+ */
+static int
+seek_window(const char *path, const struct stat *st)
+{
+  uint64_t count;
+  struct IndexEntry *entries = load_index(path, st, &count);
+
+  if (!entries)
+    entries = build_index(path, st, &count);
+
+  if (!entries)
+    return 0;
+
+  /* First entry with second not before window start */
+  uint64_t low = 0;
+  uint64_t high = count;
+  while (low < high) {
+    uint64_t mid = low + (high - low) / 2;
+
+    if (entries[mid].sec < window_start)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  offset = low < count ? entries[low].offset : size;
+  free(entries);
+
+  return 1;
+}
+
+InitRT
+init(const char *arg)
+{
+  const char *path = parse_arg(arg);
+  if (!path)
+    return (InitRT){RESULT_ERROR, "Invalid plugin argument"};
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return error(path);
+
+  struct stat st;
+  if (fstat(fd, &st)) {
+    close(fd);
+    return error("fstat");
+  }
+  size = st.st_size;
+
+  if (size < GLOBAL_HEADER_SIZE) {
+    close(fd);
+    return (InitRT){RESULT_ERROR, "File is too short to be pcap"};
+  }
+
+  map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return error("mmap");
+
+  /* File is read once from start to end, hints are not mandatory */
+  madvise((void *)map, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  madvise((void *)map, size, MADV_HUGEPAGE);
+#endif
+
+  uint32_t magic;
+  memcpy(&magic, map, sizeof(magic));
+  swapped = magic == __builtin_bswap32(MAGIC_USEC)
+    || magic == __builtin_bswap32(MAGIC_NSEC);
+  magic = read32(map);
+
+  if (magic != MAGIC_USEC && magic != MAGIC_NSEC)
+    return (InitRT){RESULT_ERROR, "Unknown pcap magic number"};
+
+  nanoseconds = magic == MAGIC_NSEC;
+  offset = GLOBAL_HEADER_SIZE;
+
+  if (window_start && !seek_window(path, &st))
+    return (InitRT){RESULT_ERROR, "Could not build time index"};
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+FinalizeRT
+finalize()
+{
+  if (map != MAP_FAILED)
+    munmap((void *)map, size);
+}
+
+/**
+ * Reads next record directly from mapping. Returns zero at the end
+ * of file, at the end of time window or when the last record is truncated.
+ */
+static int
+next_record(struct Packet *packet)
+{
+  while (size - offset >= RECORD_HEADER_SIZE
+      && read32(map + offset) < window_start) {
+    uint32_t caplen = read32(map + offset + 8);
+
+    if (size - offset - RECORD_HEADER_SIZE < caplen)
+      return 0;
+
+    offset += RECORD_HEADER_SIZE + caplen;
+  }
+
+  if (size - offset < RECORD_HEADER_SIZE)
+    return 0;
+
+  const unsigned char *data = map + offset;
+  struct RecordHeader header = {
+    read32(data),
+    read32(data + 4),
+    read32(data + 8),
+    read32(data + 12)
+  };
+
+  if (size - offset - RECORD_HEADER_SIZE < header.caplen)
+    return 0;
+
+  if (header.sec >= window_end) {
+    offset = size;
+    return 0;
+  }
+
+  *packet = (struct Packet){
+    data + RECORD_HEADER_SIZE,
+    header.len,
+    header.caplen,
+    header.sec,
+    nanoseconds ? header.frac / 1000 : header.frac
+  };
+  offset += RECORD_HEADER_SIZE + header.caplen;
+
+  return 1;
+}
+
+GetPacketRT
+get_packet()
+{
+  struct Packet packet;
+
+  if (next_record(&packet))
+    return (GetPacketRT){CAPTURE_PACKET, packet};
+
+  return (GetPacketRT){CAPTURE_END_OF_INPUT, {}};
+}
+
+GetPacketsRT
+get_packets(struct Packet *out, unsigned int max)
+{
+  unsigned int count = 0;
+
+  while (count < max && next_record(&out[count]))
+    ++count;
+
+  if (count)
+    return (GetPacketsRT){CAPTURE_PACKET, count};
+
+  return (GetPacketsRT){CAPTURE_END_OF_INPUT, 0};
+}
+
+/**
+ * Function lease packets hands out pointers into the mapping, which
+ * stays valid until finalize, so releasing packets is a no-op.
+ */
+GetPacketsRT
+lease_packets(struct LeasedPacket *out, unsigned int max)
+{
+  unsigned int count = 0;
+
+  while (count < max && next_record(&out[count].packet)) {
+    out[count].handle = (void *)map;
+    ++count;
+  }
+
+  if (count)
+    return (GetPacketsRT){CAPTURE_PACKET, count};
+
+  return (GetPacketsRT){CAPTURE_END_OF_INPUT, 0};
+}
+
+ReleasePacketsRT
+release_packets(void *const *handles, unsigned int n)
+{
+  (void)handles;
+  (void)n;
+}
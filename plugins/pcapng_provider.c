@@ -0,0 +1,384 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <input.h>
+
+/* https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-02.html */
+#define BLOCK_SHB 0x0A0D0D0A
+#define BLOCK_IDB 0x00000001
+#define BLOCK_SPB 0x00000003
+#define BLOCK_EPB 0x00000006
+#define BYTE_ORDER_MAGIC 0x1A2B3C4D
+
+#define BLOCK_HEADER_SIZE 8
+#define BLOCK_MIN_SIZE 12
+#define SHB_BODY_SIZE 16
+#define IDB_BODY_SIZE 8
+#define SPB_BODY_SIZE 4
+#define EPB_BODY_SIZE 20
+
+#define OPT_ENDOFOPT 0
+#define OPT_IF_TSRESOL 9
+#define OPT_IF_TSOFFSET 14
+
+#define USEC_PER_SEC 1000000
+
+/* Largest if_tsresol exponents whose units fit in 64 bits */
+#define MAX_EXPONENT_10 19
+#define MAX_EXPONENT_2 63
+
+#define LINKTYPE_ETHERNET 1
+
+/**
+ * Link type and timestamp properties of one interface.
+ */
+struct Interface {
+  uint16_t link_type;
+  uint64_t units;
+  int64_t offset;
+};
+
+static const unsigned char *map = MAP_FAILED;
+static size_t size;
+static size_t offset;
+static int swapped;
+
+/* Interfaces of all sections, ids of a section start at section_base */
+static struct Interface *interface_table;
+static unsigned int interface_count;
+static unsigned int interface_capacity;
+static unsigned int section_base;
+
+static char errbuf[256];
+
+InfoRT
+info()
+{
+  return (InfoRT){
+    "PcapngInput",
+    INPUT_PLUGIN,
+    "Input from file in pcapng format using memory mapping\n"
+    "The argument is a path to the pcapng file. Packets of all interfaces\n"
+    "are processed, interface ids are numbered across all sections.\n"
+    "Packets of interfaces with link type other than Ethernet are skipped\n"
+  };
+}
+
+static InitRT
+error(const char *msg)
+{
+  snprintf(errbuf, sizeof(errbuf), "%s: %s", msg, strerror(errno));
+  return (InitRT){RESULT_ERROR, errbuf};
+}
+
+static uint16_t
+read16(const unsigned char *data)
+{
+  uint16_t value;
+  memcpy(&value, data, sizeof(value));
+  return swapped ? __builtin_bswap16(value) : value;
+}
+
+static uint32_t
+read32(const unsigned char *data)
+{
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return swapped ? __builtin_bswap32(value) : value;
+}
+
+static uint64_t
+read64(const unsigned char *data)
+{
+  uint64_t value;
+  memcpy(&value, data, sizeof(value));
+  return swapped ? __builtin_bswap64(value) : value;
+}
+
+static int
+parse_section(const unsigned char *body)
+{
+  uint32_t magic;
+  memcpy(&magic, body, sizeof(magic));
+
+  if (magic != BYTE_ORDER_MAGIC && magic != __builtin_bswap32(BYTE_ORDER_MAGIC))
+    return 0;
+
+  swapped = magic != BYTE_ORDER_MAGIC;
+  section_base = interface_count;
+
+  return 1;
+}
+
+static int
+parse_interface(const unsigned char *body, const unsigned char *end)
+{
+  struct Interface iface = {read16(body), USEC_PER_SEC, 0};
+
+  /* Options are padded to 32 bits */
+  for (const unsigned char *opt = body + IDB_BODY_SIZE; opt + 4 <= end;) {
+    uint16_t code = read16(opt);
+    uint16_t len = read16(opt + 2);
+    const unsigned char *value = opt + 4;
+
+    if (code == OPT_ENDOFOPT || value + len > end)
+      break;
+
+    if (code == OPT_IF_TSRESOL && len == 1) {
+      unsigned int exponent = *value & 0x7F;
+      uint64_t base = (*value & 0x80) ? 2 : 10;
+
+      /* Larger units would overflow and timestamps would be divided by 0 */
+      if (exponent > (base == 2 ? MAX_EXPONENT_2 : MAX_EXPONENT_10))
+        return 0;
+
+      iface.units = 1;
+      for (unsigned int i = 0; i < exponent; ++i)
+        iface.units *= base;
+    }
+
+    if (code == OPT_IF_TSOFFSET && len == 8)
+      iface.offset = (int64_t)read64(value);
+
+    opt = value + ((len + 3u) & ~3u);
+  }
+
+  if (interface_count == interface_capacity) {
+    unsigned int capacity = interface_capacity ? interface_capacity * 2 : 8;
+    struct Interface *resized = realloc(interface_table,
+        capacity * sizeof(*interface_table));
+
+    if (!resized)
+      return 0;
+
+    interface_table = resized;
+    interface_capacity = capacity;
+  }
+
+  interface_table[interface_count++] = iface;
+
+  return 1;
+}
+
+InitRT
+init(const char *arg)
+{
+  int fd = open(arg, O_RDONLY);
+  if (fd < 0)
+    return error(arg);
+
+  struct stat st;
+  if (fstat(fd, &st)) {
+    close(fd);
+    return error("fstat");
+  }
+  size = st.st_size;
+
+  if (size < BLOCK_MIN_SIZE + SHB_BODY_SIZE) {
+    close(fd);
+    return (InitRT){RESULT_ERROR, "File is too short to be pcapng"};
+  }
+
+  map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return error("mmap");
+
+  /* File is read once from start to end, hints are not mandatory */
+  madvise((void *)map, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  madvise((void *)map, size, MADV_HUGEPAGE);
+#endif
+
+  uint32_t type;
+  memcpy(&type, map, sizeof(type));
+
+  if (type != BLOCK_SHB || !parse_section(map + BLOCK_HEADER_SIZE))
+    return (InitRT){RESULT_ERROR, "File does not start with section header"};
+
+  offset = 0;
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+FinalizeRT
+finalize()
+{
+  if (map != MAP_FAILED)
+    munmap((void *)map, size);
+
+  free(interface_table);
+}
+
+/**
+ * Function interfaces tells that packets carry id of their interface.
+ */
+InterfacesRT
+interfaces()
+{
+  return 1;
+}
+
+static void
+convert_timestamp(const struct Interface *iface, uint64_t ts,
+    struct Packet *packet)
+{
+  uint64_t frac = ts % iface->units;
+
+  packet->sec = ts / iface->units + iface->offset;
+  packet->usec = iface->units == USEC_PER_SEC
+    ? frac
+    : (unsigned __int128)frac * USEC_PER_SEC / iface->units;
+}
+
+/**
+ * Walks blocks until next packet block. Other blocks only update state
+ * of sections and interfaces. Returns zero at the end of file or when
+ * a malformed block is found.
+ */
+static int
+next_record(struct Packet *packet)
+{
+  while (size - offset >= BLOCK_MIN_SIZE) {
+    const unsigned char *block = map + offset;
+    uint32_t type;
+    memcpy(&type, block, sizeof(type));
+
+    /* Section header decides byte order of its own length */
+    if (type == BLOCK_SHB) {
+      if (size - offset < BLOCK_MIN_SIZE + SHB_BODY_SIZE
+          || !parse_section(block + BLOCK_HEADER_SIZE))
+        return 0;
+    } else {
+      type = read32(block);
+    }
+
+    uint32_t len = read32(block + 4);
+    if (len < BLOCK_MIN_SIZE || len % 4 || len > size - offset)
+      return 0;
+
+    const unsigned char *body = block + BLOCK_HEADER_SIZE;
+    const unsigned char *end = block + len - 4;
+    offset += len;
+
+    switch (type) {
+      case BLOCK_IDB:
+        if (body + IDB_BODY_SIZE > end || !parse_interface(body, end))
+          return 0;
+        break;
+
+      case BLOCK_EPB: {
+        if (body + EPB_BODY_SIZE > end)
+          return 0;
+
+        unsigned int id = section_base + read32(body);
+        uint32_t caplen = read32(body + 12);
+        if (id >= interface_count
+            || caplen > (size_t)(end - body - EPB_BODY_SIZE))
+          return 0;
+
+        /* Flower parses Ethernet frames only */
+        if (interface_table[id].link_type != LINKTYPE_ETHERNET)
+          continue;
+
+        *packet = (struct Packet){
+          body + EPB_BODY_SIZE,
+          read32(body + 16),
+          caplen,
+          0,
+          0,
+          id
+        };
+        convert_timestamp(&interface_table[id],
+            ((uint64_t)read32(body + 4) << 32) | read32(body + 8), packet);
+        return 1;
+      }
+
+      case BLOCK_SPB: {
+        if (body + SPB_BODY_SIZE > end || section_base >= interface_count)
+          return 0;
+
+        if (interface_table[section_base].link_type != LINKTYPE_ETHERNET)
+          continue;
+
+        /* Simple packet block carries no timestamp and no capture length */
+        uint32_t orig = read32(body);
+        uint32_t available = end - body - SPB_BODY_SIZE;
+
+        *packet = (struct Packet){
+          body + SPB_BODY_SIZE,
+          orig,
+          orig < available ? orig : available,
+          0,
+          0,
+          section_base
+        };
+        return 1;
+      }
+
+      default:
+        break;
+    }
+  }
+
+  return 0;
+}
+
+GetPacketRT
+get_packet()
+{
+  struct Packet packet;
+
+  if (next_record(&packet))
+    return (GetPacketRT){CAPTURE_PACKET, packet};
+
+  return (GetPacketRT){CAPTURE_END_OF_INPUT, {}};
+}
+
+GetPacketsRT
+get_packets(struct Packet *out, unsigned int max)
+{
+  unsigned int count = 0;
+
+  while (count < max && next_record(&out[count]))
+    ++count;
+
+  if (count)
+    return (GetPacketsRT){CAPTURE_PACKET, count};
+
+  return (GetPacketsRT){CAPTURE_END_OF_INPUT, 0};
+}
+
+/**
+ * Function lease packets hands out pointers into the mapping, which
+ * stays valid until finalize, so releasing packets is a no-op.
+ */
+GetPacketsRT
+lease_packets(struct LeasedPacket *out, unsigned int max)
+{
+  unsigned int count = 0;
+
+  while (count < max && next_record(&out[count].packet)) {
+    out[count].handle = (void *)map;
+    ++count;
+  }
+
+  if (count)
+    return (GetPacketsRT){CAPTURE_PACKET, count};
+
+  return (GetPacketsRT){CAPTURE_END_OF_INPUT, 0};
+}
+
+ReleasePacketsRT
+release_packets(void *const *handles, unsigned int n)
+{
+  (void)handles;
+  (void)n;
+}
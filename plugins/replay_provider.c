@@ -0,0 +1,309 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <input.h>
+
+#define MAGIC_USEC 0xa1b2c3d4
+#define MAGIC_NSEC 0xa1b23c4d
+#define GLOBAL_HEADER_SIZE 24
+#define RECORD_HEADER_SIZE 16
+#define ARG_SIZE 4096
+
+#define NSEC_PER_USEC 1000
+#define NSEC_PER_SEC 1000000000
+#define USEC_PER_SEC 1000000
+
+/* Sleep is imprecise, the last part of every wait is spent spinning */
+#define SPIN_NSEC 50000
+
+/* Longest wait for one packet, so that flower stays responsive */
+#define MAX_WAIT_NSEC 100000000
+
+static const unsigned char *map = MAP_FAILED;
+static size_t size;
+static size_t offset;
+static int swapped;
+static int nanoseconds;
+
+static double speed = 1;
+
+/* Replay clock is anchored at the first returned packet */
+static int started;
+static uint64_t base_record;
+static uint64_t base_clock;
+static uint64_t base_wall;
+
+/* Offset of the latest record, out of order records do not go back */
+static uint64_t last_offset;
+
+static char errbuf[256];
+
+InfoRT
+info()
+{
+  return (InfoRT){
+    "ReplayInput",
+    INPUT_PLUGIN,
+    "Input from file in pcap format replayed at recorded speed\n"
+    "The argument is a path to the pcap file optionally followed by speed\n"
+    "multiplier, e.g. 'dump.pcap,speed=10'. Packets are returned at their\n"
+    "recorded inter-packet gaps divided by speed, timestamps are moved\n"
+    "to the time of replay\n"
+  };
+}
+
+static InitRT
+error(const char *msg)
+{
+  snprintf(errbuf, sizeof(errbuf), "%s: %s", msg, strerror(errno));
+  return (InitRT){RESULT_ERROR, errbuf};
+}
+
+static uint32_t
+read32(const unsigned char *data)
+{
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return swapped ? __builtin_bswap32(value) : value;
+}
+
+static uint64_t
+clock_nsec(clockid_t clock)
+{
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static const char *
+parse_arg(const char *arg)
+{
+  static char copy[ARG_SIZE];
+  char *save;
+
+  strncpy(copy, arg, sizeof(copy) - 1);
+
+  char *path = strtok_r(copy, ",", &save);
+  char *token;
+
+  while ((token = strtok_r(NULL, ",", &save))) {
+    char *value = strchr(token, '=');
+    if (!value)
+      return NULL;
+    *value++ = '\0';
+
+    if (!strcmp(token, "speed"))
+      speed = strtod(value, NULL);
+    else
+      return NULL;
+  }
+
+  return speed > 0 ? path : NULL;
+}
+
+InitRT
+init(const char *arg)
+{
+  const char *path = parse_arg(arg);
+  if (!path)
+    return (InitRT){RESULT_ERROR, "Invalid plugin argument"};
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return error(path);
+
+  struct stat st;
+  if (fstat(fd, &st)) {
+    close(fd);
+    return error("fstat");
+  }
+  size = st.st_size;
+
+  if (size < GLOBAL_HEADER_SIZE) {
+    close(fd);
+    return (InitRT){RESULT_ERROR, "File is too short to be pcap"};
+  }
+
+  map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return error("mmap");
+
+  madvise((void *)map, size, MADV_SEQUENTIAL);
+
+  uint32_t magic;
+  memcpy(&magic, map, sizeof(magic));
+  swapped = magic == __builtin_bswap32(MAGIC_USEC)
+    || magic == __builtin_bswap32(MAGIC_NSEC);
+  magic = read32(map);
+
+  if (magic != MAGIC_USEC && magic != MAGIC_NSEC)
+    return (InitRT){RESULT_ERROR, "Unknown pcap magic number"};
+
+  nanoseconds = magic == MAGIC_NSEC;
+  offset = GLOBAL_HEADER_SIZE;
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+FinalizeRT
+finalize()
+{
+  if (map != MAP_FAILED)
+    munmap((void *)map, size);
+}
+
+/**
+ * Returns timestamp of the next record in microseconds, or zero
+ * if there is no complete record left.
+ */
+static int
+peek_record(uint64_t *timestamp)
+{
+  if (size - offset < RECORD_HEADER_SIZE)
+    return 0;
+
+  const unsigned char *data = map + offset;
+  if (size - offset - RECORD_HEADER_SIZE < read32(data + 8))
+    return 0;
+
+  uint32_t frac = read32(data + 4);
+  *timestamp = (uint64_t)read32(data) * USEC_PER_SEC
+    + (nanoseconds ? frac / 1000 : frac);
+
+  return 1;
+}
+
+/**
+ * Converts record timestamp to replay offset in nanoseconds. Records
+ * older than a previous one are replayed immediately with its offset, so
+ * that replayed timestamps never go backwards.
+ */
+static uint64_t
+replay_offset(uint64_t timestamp)
+{
+  if (timestamp > base_record) {
+    uint64_t offset = (timestamp - base_record) * NSEC_PER_USEC / speed;
+
+    if (offset > last_offset)
+      last_offset = offset;
+  }
+
+  return last_offset;
+}
+
+/**
+ * Waits until deadline on monotonic clock using sleep for the bulk
+ * of the wait and spinning for the rest. Waits at most MAX_WAIT_NSEC,
+ * returns zero if the deadline was not reached.
+ */
+static int
+wait_until(uint64_t deadline)
+{
+  uint64_t now = clock_nsec(CLOCK_MONOTONIC);
+  if (now >= deadline)
+    return 1;
+
+  int reached = deadline - now <= MAX_WAIT_NSEC;
+  uint64_t until = reached ? deadline : now + MAX_WAIT_NSEC;
+
+  if (until - now > SPIN_NSEC) {
+    uint64_t wake = until - SPIN_NSEC;
+    struct timespec ts = {wake / NSEC_PER_SEC, wake % NSEC_PER_SEC};
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+  }
+
+  while (clock_nsec(CLOCK_MONOTONIC) < until) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+
+  return reached;
+}
+
+static struct Packet
+take_record(uint64_t timestamp)
+{
+  const unsigned char *data = map + offset;
+  uint32_t caplen = read32(data + 8);
+  uint64_t wall = base_wall + replay_offset(timestamp) / NSEC_PER_USEC;
+
+  offset += RECORD_HEADER_SIZE + caplen;
+
+  return (struct Packet){
+    data + RECORD_HEADER_SIZE,
+    read32(data + 12),
+    caplen,
+    wall / USEC_PER_SEC,
+    wall % USEC_PER_SEC
+  };
+}
+
+/**
+ * Waits for the next record to be due. Long gaps are split to timeouts.
+ */
+static enum GetPacketResultType
+wait_record(uint64_t *timestamp)
+{
+  if (!peek_record(timestamp))
+    return CAPTURE_END_OF_INPUT;
+
+  if (!started) {
+    base_record = *timestamp;
+    base_clock = clock_nsec(CLOCK_MONOTONIC);
+    base_wall = clock_nsec(CLOCK_REALTIME) / NSEC_PER_USEC;
+    started = 1;
+  }
+
+  if (!wait_until(base_clock + replay_offset(*timestamp)))
+    return CAPTURE_TIMEOUT;
+
+  return CAPTURE_PACKET;
+}
+
+GetPacketRT
+get_packet()
+{
+  uint64_t timestamp;
+  enum GetPacketResultType type = wait_record(&timestamp);
+
+  if (type != CAPTURE_PACKET)
+    return (GetPacketRT){type, {}};
+
+  return (GetPacketRT){CAPTURE_PACKET, take_record(timestamp)};
+}
+
+/**
+ * Function get packets waits for the first packet only, the rest of
+ * the batch are packets that are already due.
+ */
+GetPacketsRT
+get_packets(struct Packet *out, unsigned int max)
+{
+  uint64_t timestamp;
+  enum GetPacketResultType type = wait_record(&timestamp);
+
+  if (type != CAPTURE_PACKET)
+    return (GetPacketsRT){type, 0};
+
+  unsigned int count = 0;
+  uint64_t now = clock_nsec(CLOCK_MONOTONIC);
+
+  do {
+    out[count++] = take_record(timestamp);
+  } while (count < max && peek_record(&timestamp)
+      && base_clock + replay_offset(timestamp) <= now);
+
+  return (GetPacketsRT){CAPTURE_PACKET, count};
+}
@@ -0,0 +1,645 @@
+#include <arpa/inet.h>
+#include <endian.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/virtio_net.h>
+#include <net/if.h>
+#include <pcap.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <input.h>
+
+#define DEFAULT_RING_SIZE (64u << 20)
+#define DEFAULT_BLOCK_SIZE (4u << 20)
+#define DEFAULT_TIMEOUT 100
+#define FRAME_SIZE 2048
+#define ARG_SIZE 256
+#define MAX_SOCKETS 64
+
+#ifndef DLT_LINUX_SLL2
+#define DLT_LINUX_SLL2 276
+#endif
+
+/**
+ * One AF_PACKET socket with its ring. With fanout every socket is
+ * a separate queue read by its own thread.
+ */
+struct Socket {
+  int fd;
+  unsigned char *ring;
+
+  /* Block currently owned by user space, NULL if none */
+  struct tpacket_block_desc *block;
+  unsigned int block_index;
+  struct tpacket3_hdr *frame;
+  unsigned int frames_left;
+
+  /* References to each block held by plugin and by leased packets */
+  unsigned int *refs;
+
+  /* Blocks in user space form a run starting at tail, they are given back
+   * to kernel in ring order by capture thread once no references are left */
+  unsigned int tail;
+  unsigned int held;
+
+  struct Statistics stats;
+};
+
+/* Frames are preceded by virtio net header describing GRO segments, only
+ * if requested by argument */
+static int vnet_hdr = 0;
+
+static struct Socket sockets[MAX_SOCKETS];
+static unsigned int socket_count = 1;
+static struct tpacket_req3 req;
+static unsigned int timeout = DEFAULT_TIMEOUT;
+static int fanout_mode = PACKET_FANOUT_HASH;
+
+static const char *filter = "";
+static unsigned int snaplen = 0;
+static struct bpf_program program;
+
+static char errbuf[PCAP_ERRBUF_SIZE];
+
+/**
+ * Layout of struct sock_fprog, linux/filter.h conflicts with pcap.h.
+ */
+struct SocketFilter {
+  unsigned short len;
+  struct bpf_insn *insns;
+};
+
+/* Filter dropping all packets until socket is set up */
+static struct bpf_insn drop_all[] = {
+  BPF_STMT(BPF_RET | BPF_K, 0)
+};
+
+InfoRT
+info()
+{
+  return (InfoRT){
+    "RingInput",
+    INPUT_PLUGIN,
+    "Input from network interface using AF_PACKET TPACKET_V3 ring\n"
+    "The argument is a name of the interface optionally followed by\n"
+    "comma separated options, e.g. eth0,ring_size=67108864,block_size=4194304\n"
+    "  ring_size   - size of the whole ring in bytes [default: 64 MiB]\n"
+    "  block_size  - size of one block in bytes, power of two multiple of\n"
+    "                page size [default: 4 MiB]\n"
+    "  timeout     - block retire timeout in milliseconds [default: 100]\n"
+    "  fanout      - number of sockets in fanout group, each with its own\n"
+    "                ring and processing pipeline [default: 1]\n"
+    "  fanout_mode - hash to spread flows by symmetric flow hash or cpu to\n"
+    "                follow receiving CPU [default: hash]\n"
+    "  vnet_hdr    - 1 to count segments of GRO frames by their virtio net\n"
+    "                header, needs Linux 5.7 or newer, kernel drops GRO\n"
+    "                frames the header can not describe [default: 0]\n"
+  };
+}
+
+static InitRT
+error(const char *msg)
+{
+  snprintf(errbuf, sizeof(errbuf), "%s: %s", msg, strerror(errno));
+  return (InitRT){RESULT_ERROR, errbuf};
+}
+
+/**
+ * Parses plugin argument. The first comma separated token is interface
+ * name, following tokens are key=value options.
+ */
+static int
+parse_arg(const char *arg, char *iface, unsigned int *ring_size,
+    unsigned int *block_size)
+{
+  static char copy[ARG_SIZE];
+  char *save;
+
+  strncpy(copy, arg, sizeof(copy) - 1);
+
+  char *token = strtok_r(copy, ",", &save);
+  if (!token || strlen(token) >= IFNAMSIZ)
+    return 0;
+  strcpy(iface, token);
+
+  while ((token = strtok_r(NULL, ",", &save))) {
+    char *value = strchr(token, '=');
+    if (!value)
+      return 0;
+    *value++ = '\0';
+
+    unsigned long number = strtoul(value, NULL, 0);
+    if (!strcmp(token, "ring_size"))
+      *ring_size = number;
+    else if (!strcmp(token, "block_size"))
+      *block_size = number;
+    else if (!strcmp(token, "timeout"))
+      timeout = number;
+    else if (!strcmp(token, "fanout"))
+      socket_count = number;
+    else if (!strcmp(token, "fanout_mode") && !strcmp(value, "hash"))
+      fanout_mode = PACKET_FANOUT_HASH;
+    else if (!strcmp(token, "fanout_mode") && !strcmp(value, "cpu"))
+      fanout_mode = PACKET_FANOUT_CPU;
+    else if (!strcmp(token, "vnet_hdr"))
+      vnet_hdr = number != 0;
+    else
+      return 0;
+  }
+
+  return socket_count && socket_count <= MAX_SOCKETS;
+}
+
+/**
+ * Function configure stores capture options. They are compiled to socket
+ * filter once the ring is set up.
+ */
+ConfigureRT
+configure(const struct CaptureOptions *options)
+{
+  static char copy[PCAP_BUF_SIZE];
+
+  if (strlen(options->filter) >= sizeof(copy))
+    return (ConfigureRT){RESULT_ERROR, "Filter is too long"};
+
+  strcpy(copy, options->filter);
+  filter = copy;
+  snaplen = options->snaplen;
+
+  return (ConfigureRT){RESULT_OK, ""};
+}
+
+/**
+ * Compiles filter expression to classic BPF. Program returns snaplen for
+ * matching packets, so kernel copies only that many bytes into ring.
+ * Link type is taken from interface, so that offsets in program match
+ * headers kernel passes to socket.
+ */
+static InitRT
+compile_filter(const char *iface)
+{
+  pcap_t *live = pcap_open_live(iface, 0xFFFF, 0, 0, errbuf);
+  if (!live)
+    return (InitRT){RESULT_ERROR, errbuf};
+
+  int link = pcap_datalink(live);
+  pcap_close(live);
+
+  /* Cooked headers are built by libpcap, raw socket never sees them */
+  if (link == DLT_LINUX_SLL || link == DLT_LINUX_SLL2)
+    return (InitRT){RESULT_ERROR, "Filter not supported on interface"};
+
+  pcap_t *dead = pcap_open_dead(link, snaplen ? snaplen : 0xFFFF);
+  if (!dead)
+    return (InitRT){RESULT_ERROR, "Cannot compile filter"};
+
+  if (pcap_compile(dead, &program, filter, 1, PCAP_NETMASK_UNKNOWN)) {
+    snprintf(errbuf, sizeof(errbuf), "%s", pcap_geterr(dead));
+    pcap_close(dead);
+    return (InitRT){RESULT_ERROR, errbuf};
+  }
+
+  pcap_close(dead);
+  return (InitRT){RESULT_OK, ""};
+}
+
+/**
+ * Opens socket with its ring and binds it to interface. With fanout the
+ * socket joins group after bind, so that it receives only its share.
+ * Until then all packets are dropped by filter, so that no packet of
+ * another socket's share gets into the ring.
+ */
+static InitRT
+open_socket(struct Socket *sock, int ifindex, int group)
+{
+  /* Socket receives nothing until bound with protocol */
+  sock->fd = socket(AF_PACKET, SOCK_RAW, 0);
+  if (sock->fd < 0)
+    return error("socket");
+
+  struct SocketFilter drop = {1, drop_all};
+  if (setsockopt(sock->fd, SOL_SOCKET, SO_ATTACH_FILTER, &drop, sizeof(drop)))
+    return error("SO_ATTACH_FILTER");
+
+  int version = TPACKET_V3;
+  if (setsockopt(sock->fd, SOL_PACKET, PACKET_VERSION, &version,
+        sizeof(version)))
+    return error("PACKET_VERSION");
+
+  /* Header must be requested before ring is set up. Kernels older than
+   * 5.7 accept it but do not write it into ring frames */
+  int enable = 1;
+  if (vnet_hdr && setsockopt(sock->fd, SOL_PACKET, PACKET_VNET_HDR, &enable,
+        sizeof(enable)))
+    return error("PACKET_VNET_HDR");
+
+  if (setsockopt(sock->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)))
+    return error("PACKET_RX_RING");
+
+  sock->refs = calloc(req.tp_block_nr, sizeof(*sock->refs));
+  if (!sock->refs)
+    return error("calloc");
+
+  sock->ring = mmap(NULL, (size_t)req.tp_block_size * req.tp_block_nr,
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, sock->fd, 0);
+  if (sock->ring == MAP_FAILED)
+    return error("mmap");
+
+  struct sockaddr_ll addr = {0};
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_ALL);
+  addr.sll_ifindex = ifindex;
+
+  if (bind(sock->fd, (struct sockaddr *)&addr, sizeof(addr)))
+    return error("bind");
+
+  struct packet_mreq mreq = {0};
+  mreq.mr_ifindex = ifindex;
+  mreq.mr_type = PACKET_MR_PROMISC;
+  if (setsockopt(sock->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq,
+        sizeof(mreq)))
+    return error("PACKET_ADD_MEMBERSHIP");
+
+  /* Fragments are not reassembled, so that packets are counted as they
+   * were on wire. Flow hash of a fragment uses only addresses, fragments
+   * of one packet still go to the same socket */
+  if (socket_count > 1) {
+    int fanout = group | fanout_mode << 16;
+
+    if (setsockopt(sock->fd, SOL_PACKET, PACKET_FANOUT, &fanout,
+          sizeof(fanout)))
+      return error("PACKET_FANOUT");
+  }
+
+  /* Socket is set up, let packets through */
+  if (program.bf_insns) {
+    struct SocketFilter fprog = {program.bf_len, program.bf_insns};
+
+    if (setsockopt(sock->fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog,
+          sizeof(fprog)))
+      return error("SO_ATTACH_FILTER");
+  } else {
+    int unused = 0;
+
+    if (setsockopt(sock->fd, SOL_SOCKET, SO_DETACH_FILTER, &unused,
+          sizeof(unused)))
+      return error("SO_DETACH_FILTER");
+  }
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+InitRT
+init(const char *arg)
+{
+  char iface[IFNAMSIZ];
+  unsigned int ring_size = DEFAULT_RING_SIZE;
+  unsigned int block_size = DEFAULT_BLOCK_SIZE;
+
+  for (unsigned int i = 0; i < MAX_SOCKETS; ++i)
+    sockets[i] = (struct Socket){-1, MAP_FAILED};
+
+  if (!parse_arg(arg, iface, &ring_size, &block_size))
+    return (InitRT){RESULT_ERROR, "Invalid plugin argument"};
+
+  if (block_size < FRAME_SIZE || block_size % getpagesize()
+      || ring_size < block_size)
+    return (InitRT){RESULT_ERROR, "Invalid ring or block size"};
+
+  int ifindex = if_nametoindex(iface);
+  if (!ifindex)
+    return error(iface);
+
+  /* With TPACKET_V3 frames are variable sized, frame size is only
+   * used by kernel for sanity checks */
+  memset(&req, 0, sizeof(req));
+  req.tp_block_size = block_size;
+  req.tp_block_nr = ring_size / block_size;
+  req.tp_frame_size = FRAME_SIZE;
+  req.tp_frame_nr = (block_size / FRAME_SIZE) * req.tp_block_nr;
+  req.tp_retire_blk_tov = timeout;
+
+  if (*filter || snaplen) {
+    InitRT result = compile_filter(iface);
+    if (result.type != RESULT_OK)
+      return result;
+  }
+
+  /* Fanout group ids are global, process id keeps instances apart */
+  int group = getpid() & 0xFFFF;
+
+  for (unsigned int i = 0; i < socket_count; ++i) {
+    InitRT result = open_socket(&sockets[i], ifindex, group);
+    if (result.type != RESULT_OK)
+      return result;
+  }
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+FinalizeRT
+finalize()
+{
+  for (unsigned int i = 0; i < MAX_SOCKETS; ++i) {
+    struct Socket *sock = &sockets[i];
+
+    if (sock->ring != MAP_FAILED)
+      munmap(sock->ring, (size_t)req.tp_block_size * req.tp_block_nr);
+
+    if (sock->fd >= 0)
+      close(sock->fd);
+
+    free(sock->refs);
+  }
+
+  if (program.bf_insns)
+    pcap_freecode(&program);
+}
+
+QueueCountRT
+queue_count()
+{
+  return socket_count;
+}
+
+static struct tpacket_block_desc *
+block_at(struct Socket *sock, unsigned int index)
+{
+  return (struct tpacket_block_desc *)
+    (sock->ring + (size_t)index * req.tp_block_size);
+}
+
+static int
+block_ready(struct tpacket_block_desc *desc)
+{
+  return __atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE)
+    & TP_STATUS_USER;
+}
+
+/**
+ * Drops one reference to block. It may be called from any thread, only
+ * capture thread gives blocks back to kernel.
+ */
+static void
+unref_block(struct Socket *sock, unsigned int index)
+{
+  __atomic_sub_fetch(&sock->refs[index], 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Gives blocks without references back to kernel in ring order. Kernel
+ * fills blocks in the same order, so a block still leased at tail stops
+ * it anyway.
+ */
+static void
+return_blocks(struct Socket *sock)
+{
+  while (sock->held
+      && !__atomic_load_n(&sock->refs[sock->tail], __ATOMIC_ACQUIRE)) {
+    __atomic_store_n(&block_at(sock, sock->tail)->hdr.bh1.block_status,
+        TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    sock->tail = (sock->tail + 1) % req.tp_block_nr;
+    --sock->held;
+  }
+}
+
+/**
+ * Drops plugin reference to block currently owned by user space
+ * and moves to the next block in ring.
+ */
+static void
+release_block(struct Socket *sock)
+{
+  sock->block = NULL;
+  unref_block(sock, sock->block_index);
+  sock->block_index = (sock->block_index + 1) % req.tp_block_nr;
+  return_blocks(sock);
+}
+
+/**
+ * Waits for next block to be retired by kernel. Whole block
+ * of frames is then handed out without copying.
+ */
+static enum GetPacketResultType
+next_block(struct Socket *sock)
+{
+  struct tpacket_block_desc *desc = block_at(sock, sock->block_index);
+
+  return_blocks(sock);
+
+  /* All blocks are held by leased packets, kernel has nowhere to store
+   * new ones, so wait for them to be released */
+  if (sock->held == req.tp_block_nr) {
+    struct timespec backoff = {0, 1000000};
+
+    nanosleep(&backoff, NULL);
+    return CAPTURE_TIMEOUT;
+  }
+
+  if (!block_ready(desc)) {
+    struct pollfd pfd = {sock->fd, POLLIN | POLLERR, 0};
+
+    if (poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+      return CAPTURE_INPUT_ERROR;
+
+    if (!block_ready(desc))
+      return CAPTURE_TIMEOUT;
+  }
+
+  __atomic_store_n(&sock->refs[sock->block_index], 1, __ATOMIC_RELAXED);
+  ++sock->held;
+  sock->block = desc;
+  sock->frames_left = desc->hdr.bh1.num_pkts;
+  sock->frame = (struct tpacket3_hdr *)
+    ((unsigned char *)desc + desc->hdr.bh1.offset_to_first_pkt);
+
+  return CAPTURE_PACKET;
+}
+
+/**
+ * Makes sure there are frames left in the current block. Block is given
+ * back to kernel once all of its frames were handed out.
+ */
+static enum GetPacketResultType
+ensure_frames(struct Socket *sock)
+{
+  while (!sock->frames_left) {
+    if (sock->block)
+      release_block(sock);
+
+    enum GetPacketResultType type = next_block(sock);
+    if (type != CAPTURE_PACKET)
+      return type;
+  }
+
+  return CAPTURE_PACKET;
+}
+
+/**
+ * Gets segment size of frame coalesced by GRO, zero for a single packet.
+ * Virtio net header is stored right before the frame data.
+ */
+static unsigned int
+segment_size(const unsigned char *data)
+{
+  if (!vnet_hdr)
+    return 0;
+
+  const struct virtio_net_hdr *vnet = (const struct virtio_net_hdr *)
+    (data - sizeof(*vnet));
+
+  if ((vnet->gso_type & ~VIRTIO_NET_HDR_GSO_ECN) == VIRTIO_NET_HDR_GSO_NONE)
+    return 0;
+
+  return le16toh(vnet->gso_size);
+}
+
+static struct Packet
+take_frame(struct Socket *sock)
+{
+  struct tpacket3_hdr *hdr = sock->frame;
+  sock->frame = (struct tpacket3_hdr *)
+    ((unsigned char *)hdr + hdr->tp_next_offset);
+  --sock->frames_left;
+
+  const unsigned char *data = (const unsigned char *)hdr + hdr->tp_mac;
+
+  return (struct Packet){
+    data,
+    hdr->tp_len,
+    hdr->tp_snaplen,
+    hdr->tp_sec,
+    hdr->tp_nsec / 1000,
+    0,
+    0,
+    segment_size(data)
+  };
+}
+
+/**
+ * Function get packet returns frames of the current block.
+ */
+GetPacketRT
+get_packet_q(unsigned int queue)
+{
+  struct Socket *sock = &sockets[queue];
+
+  enum GetPacketResultType type = ensure_frames(sock);
+  if (type != CAPTURE_PACKET)
+    return (GetPacketRT){type, {}};
+
+  return (GetPacketRT){CAPTURE_PACKET, take_frame(sock)};
+}
+
+/**
+ * Function get packets returns up to max frames of one block, so that
+ * the whole batch stays valid until the next call.
+ */
+GetPacketsRT
+get_packets_q(unsigned int queue, struct Packet *out, unsigned int max)
+{
+  struct Socket *sock = &sockets[queue];
+
+  enum GetPacketResultType type = ensure_frames(sock);
+  if (type != CAPTURE_PACKET)
+    return (GetPacketsRT){type, 0};
+
+  unsigned int count = sock->frames_left < max ? sock->frames_left : max;
+  for (unsigned int i = 0; i < count; ++i)
+    out[i] = take_frame(sock);
+
+  return (GetPacketsRT){CAPTURE_PACKET, count};
+}
+
+/**
+ * Function lease packets works as get packets, but every leased frame
+ * holds reference to its block, so the frame stays valid until released.
+ * Handle encodes both socket and block.
+ */
+GetPacketsRT
+lease_packets_q(unsigned int queue, struct LeasedPacket *out,
+    unsigned int max)
+{
+  struct Socket *sock = &sockets[queue];
+
+  enum GetPacketResultType type = ensure_frames(sock);
+  if (type != CAPTURE_PACKET)
+    return (GetPacketsRT){type, 0};
+
+  unsigned int count = sock->frames_left < max ? sock->frames_left : max;
+  uintptr_t block = (uintptr_t)queue * req.tp_block_nr + sock->block_index;
+  void *handle = (void *)(block + 1);
+
+  __atomic_add_fetch(&sock->refs[sock->block_index], count, __ATOMIC_RELAXED);
+  for (unsigned int i = 0; i < count; ++i)
+    out[i] = (struct LeasedPacket){take_frame(sock), handle};
+
+  return (GetPacketsRT){CAPTURE_PACKET, count};
+}
+
+GetPacketRT
+get_packet()
+{
+  return get_packet_q(0);
+}
+
+GetPacketsRT
+get_packets(struct Packet *out, unsigned int max)
+{
+  return get_packets_q(0, out, max);
+}
+
+GetPacketsRT
+lease_packets(struct LeasedPacket *out, unsigned int max)
+{
+  return lease_packets_q(0, out, max);
+}
+
+/**
+ * Function release packets drops references of leased frames. It can
+ * be called from any thread.
+ */
+ReleasePacketsRT
+release_packets(void *const *handles, unsigned int n)
+{
+  for (unsigned int i = 0; i < n; ++i) {
+    uintptr_t block = (uintptr_t)handles[i] - 1;
+
+    unref_block(&sockets[block / req.tp_block_nr], block % req.tp_block_nr);
+  }
+}
+
+/**
+ * Function statistics returns kernel counters of all sockets. Kernel
+ * resets them on every read so they are accumulated here.
+ */
+StatisticsRT
+statistics()
+{
+  struct Statistics total = {0, 0};
+
+  for (unsigned int i = 0; i < socket_count; ++i) {
+    struct Socket *sock = &sockets[i];
+    struct tpacket_stats_v3 kstats;
+    socklen_t len = sizeof(kstats);
+
+    if (!getsockopt(sock->fd, SOL_PACKET, PACKET_STATISTICS, &kstats, &len)) {
+      sock->stats.packets += kstats.tp_packets;
+      sock->stats.drops += kstats.tp_drops;
+    }
+
+    total.packets += sock->stats.packets;
+    total.drops += sock->stats.drops;
+  }
+
+  return total;
+}
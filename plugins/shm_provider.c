@@ -0,0 +1,273 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <input.h>
+#include <shm_ring.h>
+
+#define MAX_BATCH 256
+
+/* Empty ring is polled by spinning first and sleeping afterwards */
+#define SPIN_ROUNDS 1024
+#define SLEEP_ROUNDS 20
+#define SLEEP_NSEC 50000
+
+static struct ShmRingHeader *ring = MAP_FAILED;
+static size_t map_size;
+static uint64_t tail;
+static unsigned long long consumed;
+
+/* Slots returned by get_packets, freed on the next call */
+static struct ShmSlot *pending[MAX_BATCH];
+static unsigned int pending_count;
+
+static char errbuf[256];
+
+InfoRT
+info()
+{
+  return (InfoRT){
+    "ShmInput",
+    INPUT_PLUGIN,
+    "Input from shared memory ring written by another local process\n"
+    "The argument is a name of POSIX shared memory object, e.g. '/flower'.\n"
+    "Ring layout is described in shm_ring.h, packets are read in place\n"
+  };
+}
+
+static InitRT
+error(const char *msg)
+{
+  snprintf(errbuf, sizeof(errbuf), "%s: %s", msg, strerror(errno));
+  return (InitRT){RESULT_ERROR, errbuf};
+}
+
+/**
+ * Gives slot back to producers.
+ */
+static void
+free_slot(struct ShmSlot *slot)
+{
+  uint64_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->sequence, seq - 1 + ring->slot_count,
+      __ATOMIC_RELEASE);
+}
+
+InitRT
+init(const char *arg)
+{
+  int fd = shm_open(arg, O_RDWR, 0);
+  if (fd < 0)
+    return error(arg);
+
+  struct stat st;
+  if (fstat(fd, &st)) {
+    close(fd);
+    return error("fstat");
+  }
+  map_size = st.st_size;
+
+  if (map_size < SHM_RING_HEADER_SIZE) {
+    close(fd);
+    return (InitRT){RESULT_ERROR, "Shared memory is too small for ring"};
+  }
+
+  ring = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ring == MAP_FAILED)
+    return error("mmap");
+
+  if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC
+      || ring->version != SHM_RING_VERSION)
+    return (InitRT){RESULT_ERROR, "Shared memory does not hold a ring"};
+
+  uint32_t count = ring->slot_count;
+  uint32_t slot_size = ring->slot_size;
+
+  if (!count || count & (count - 1) || slot_size % SHM_RING_ALIGN
+      || slot_size <= sizeof(struct ShmSlot)
+      || shm_ring_size(count, slot_size) > map_size)
+    return (InitRT){RESULT_ERROR, "Invalid ring geometry"};
+
+  /* Continue where the previous consumer stopped, slots it still held
+   * are given back to producers */
+  tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  for (uint64_t pos = tail > count ? tail - count : 0; pos < tail; ++pos) {
+    struct ShmSlot *slot = shm_ring_slot(ring, pos);
+
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) == pos + 1)
+      free_slot(slot);
+  }
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+static void
+free_pending()
+{
+  for (unsigned int i = 0; i < pending_count; ++i)
+    free_slot(pending[i]);
+  pending_count = 0;
+}
+
+FinalizeRT
+finalize()
+{
+  if (ring == MAP_FAILED)
+    return;
+
+  free_pending();
+  munmap(ring, map_size);
+}
+
+/**
+ * Function interfaces tells that packets carry interface set by producer.
+ */
+InterfacesRT
+interfaces()
+{
+  return 1;
+}
+
+/**
+ * Takes the next published slot, NULL if there is none.
+ */
+static struct ShmSlot *
+take_slot()
+{
+  struct ShmSlot *slot = shm_ring_slot(ring, tail);
+
+  if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != tail + 1)
+    return NULL;
+
+  ++tail;
+  ++consumed;
+  __atomic_store_n(&ring->tail, tail, __ATOMIC_RELAXED);
+
+  return slot;
+}
+
+/**
+ * Waits a while for the next slot. Ring is closed only once it is drained.
+ */
+static enum GetPacketResultType
+wait_slot(struct ShmSlot **slot)
+{
+  for (unsigned int i = 0; i < SPIN_ROUNDS + SLEEP_ROUNDS; ++i) {
+    if ((*slot = take_slot()))
+      return CAPTURE_PACKET;
+
+    if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE))
+      return (*slot = take_slot()) ? CAPTURE_PACKET : CAPTURE_END_OF_INPUT;
+
+    if (i < SPIN_ROUNDS) {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    } else {
+      struct timespec ts = {0, SLEEP_NSEC};
+      nanosleep(&ts, NULL);
+    }
+  }
+
+  return CAPTURE_TIMEOUT;
+}
+
+static struct Packet
+slot_packet(struct ShmSlot *slot)
+{
+  uint32_t room = ring->slot_size - sizeof(*slot);
+
+  return (struct Packet){
+    shm_slot_data(slot),
+    slot->len,
+    slot->caplen < room ? slot->caplen : room,
+    slot->sec,
+    slot->usec,
+    slot->interface
+  };
+}
+
+GetPacketRT
+get_packet()
+{
+  struct ShmSlot *slot;
+
+  free_pending();
+
+  enum GetPacketResultType type = wait_slot(&slot);
+  if (type != CAPTURE_PACKET)
+    return (GetPacketRT){type, {}};
+
+  pending[pending_count++] = slot;
+
+  return (GetPacketRT){CAPTURE_PACKET, slot_packet(slot)};
+}
+
+/**
+ * Function get packets returns packets in place. Their slots are kept
+ * until the next call, so that producers can not overwrite them.
+ */
+GetPacketsRT
+get_packets(struct Packet *out, unsigned int max)
+{
+  struct ShmSlot *slot;
+
+  free_pending();
+
+  enum GetPacketResultType type = wait_slot(&slot);
+  if (type != CAPTURE_PACKET)
+    return (GetPacketsRT){type, 0};
+
+  do {
+    out[pending_count] = slot_packet(slot);
+    pending[pending_count++] = slot;
+  } while (pending_count < max && pending_count < MAX_BATCH
+      && (slot = take_slot()));
+
+  return (GetPacketsRT){CAPTURE_PACKET, pending_count};
+}
+
+/**
+ * Function lease packets hands out slots directly, every slot is given
+ * back to producers once its packet is released.
+ */
+GetPacketsRT
+lease_packets(struct LeasedPacket *out, unsigned int max)
+{
+  struct ShmSlot *slot;
+
+  enum GetPacketResultType type = wait_slot(&slot);
+  if (type != CAPTURE_PACKET)
+    return (GetPacketsRT){type, 0};
+
+  unsigned int count = 0;
+  do {
+    out[count].packet = slot_packet(slot);
+    out[count].handle = slot;
+    ++count;
+  } while (count < max && (slot = take_slot()));
+
+  return (GetPacketsRT){CAPTURE_PACKET, count};
+}
+
+ReleasePacketsRT
+release_packets(void *const *handles, unsigned int n)
+{
+  for (unsigned int i = 0; i < n; ++i)
+    free_slot(handles[i]);
+}
+
+StatisticsRT
+statistics()
+{
+  unsigned long long drops = __atomic_load_n(&ring->drops, __ATOMIC_RELAXED);
+
+  return (StatisticsRT){consumed + drops, drops};
+}
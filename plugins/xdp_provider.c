@@ -0,0 +1,648 @@
+#include <errno.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <input.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define DEFAULT_FRAMES 4096
+#define DEFAULT_FRAME_SIZE 2048
+#define DEFAULT_TIMEOUT 100
+#define COMPLETION_SIZE 64
+#define ARG_SIZE 256
+#define MAX_QUEUES 64
+#define BIND_RETRIES 100
+#define BIND_RETRY_USEC 10000
+
+enum Mode {
+  MODE_AUTO,
+  MODE_SKB,
+  MODE_NATIVE
+};
+
+/**
+ * Producer and consumer indexes of one ring shared with kernel, with
+ * descriptors following them in mapped memory.
+ */
+struct Ring {
+  uint32_t *producer;
+  uint32_t *consumer;
+  uint32_t *flags;
+  void *desc;
+  uint32_t mask;
+  void *map;
+  size_t map_len;
+};
+
+/**
+ * One AF_XDP socket bound to a receive queue of interface, with its own
+ * UMEM. Every socket is a separate queue read by its own thread.
+ */
+struct Socket {
+  int fd;
+  unsigned char *umem;
+
+  struct Ring fill;
+  struct Ring rx;
+
+  /* Frames handed out by the last get_packets, returned on the next call */
+  uint64_t *pending;
+  unsigned int pending_count;
+
+  /* Fill ring is written by capture and by releasing thread */
+  int fill_lock;
+
+  uint64_t received;
+};
+
+static struct Socket sockets[MAX_QUEUES];
+static unsigned int socket_count = 1;
+static unsigned int first_queue = 0;
+static unsigned int frames = DEFAULT_FRAMES;
+static unsigned int frame_size = DEFAULT_FRAME_SIZE;
+static unsigned int timeout = DEFAULT_TIMEOUT;
+static enum Mode mode = MODE_AUTO;
+
+static int map_fd = -1;
+static int prog_fd = -1;
+static int link_fd = -1;
+
+static char errbuf[ARG_SIZE];
+
+InfoRT
+info()
+{
+  return (InfoRT){
+    "XdpInput",
+    INPUT_PLUGIN,
+    "Input from network interface using AF_XDP sockets\n"
+    "The argument is a name of the interface optionally followed by\n"
+    "comma separated options, e.g. eth0,queues=4,mode=native\n"
+    "  queue      - first receive queue of interface [default: 0]\n"
+    "  queues     - number of receive queues, each with its own socket\n"
+    "               and processing pipeline [default: 1]\n"
+    "  mode       - skb for generic XDP, native for driver XDP or auto\n"
+    "               to try native first [default: auto]\n"
+    "  frames     - number of UMEM frames of one socket, power of two\n"
+    "               [default: 4096]\n"
+    "  frame_size - size of one frame, 2048 or 4096 [default: 2048]\n"
+    "  timeout    - poll timeout in milliseconds [default: 100]\n"
+  };
+}
+
+static InitRT
+error(const char *msg)
+{
+  snprintf(errbuf, sizeof(errbuf), "%s: %s", msg, strerror(errno));
+  return (InitRT){RESULT_ERROR, errbuf};
+}
+
+static int
+sys_bpf(enum bpf_cmd cmd, union bpf_attr *attr)
+{
+  return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/**
+ * Parses plugin argument. The first comma separated token is interface
+ * name, following tokens are key=value options.
+ */
+static int
+parse_arg(const char *arg, char *iface)
+{
+  static char copy[ARG_SIZE];
+  char *save;
+
+  strncpy(copy, arg, sizeof(copy) - 1);
+
+  char *token = strtok_r(copy, ",", &save);
+  if (!token || strlen(token) >= IFNAMSIZ)
+    return 0;
+  strcpy(iface, token);
+
+  while ((token = strtok_r(NULL, ",", &save))) {
+    char *value = strchr(token, '=');
+    if (!value)
+      return 0;
+    *value++ = '\0';
+
+    unsigned long number = strtoul(value, NULL, 0);
+    if (!strcmp(token, "queue"))
+      first_queue = number;
+    else if (!strcmp(token, "queues"))
+      socket_count = number;
+    else if (!strcmp(token, "frames"))
+      frames = number;
+    else if (!strcmp(token, "frame_size"))
+      frame_size = number;
+    else if (!strcmp(token, "timeout"))
+      timeout = number;
+    else if (!strcmp(token, "mode") && !strcmp(value, "auto"))
+      mode = MODE_AUTO;
+    else if (!strcmp(token, "mode") && !strcmp(value, "skb"))
+      mode = MODE_SKB;
+    else if (!strcmp(token, "mode") && !strcmp(value, "native"))
+      mode = MODE_NATIVE;
+    else
+      return 0;
+  }
+
+  return socket_count && socket_count <= MAX_QUEUES
+    && frames && !(frames & (frames - 1))
+    && (frame_size == 2048 || frame_size == 4096);
+}
+
+/**
+ * Maps ring of socket. Descriptors of size desc_size follow
+ * the indexes at offsets reported by kernel.
+ */
+static int
+map_ring(struct Ring *ring, int fd, const struct xdp_ring_offset *off,
+    unsigned int size, size_t desc_size, off_t pgoff)
+{
+  ring->map_len = off->desc + size * desc_size;
+  ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, fd, pgoff);
+  if (ring->map == MAP_FAILED)
+    return 0;
+
+  unsigned char *base = ring->map;
+  ring->producer = (uint32_t *)(base + off->producer);
+  ring->consumer = (uint32_t *)(base + off->consumer);
+  ring->flags = (uint32_t *)(base + off->flags);
+  ring->desc = base + off->desc;
+  ring->mask = size - 1;
+
+  return 1;
+}
+
+static void
+lock_fill(struct Socket *sock)
+{
+  while (__atomic_exchange_n(&sock->fill_lock, 1, __ATOMIC_ACQUIRE))
+    while (__atomic_load_n(&sock->fill_lock, __ATOMIC_RELAXED))
+      ;
+}
+
+static void
+unlock_fill(struct Socket *sock)
+{
+  __atomic_store_n(&sock->fill_lock, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Gives frames back to kernel through fill ring. Fill ring has a slot for
+ * every frame of UMEM, so there is always enough room.
+ */
+static void
+fill_frames(struct Socket *sock, const uint64_t *addrs, unsigned int n)
+{
+  lock_fill(sock);
+
+  uint64_t *desc = sock->fill.desc;
+  uint32_t prod = *sock->fill.producer;
+
+  for (unsigned int i = 0; i < n; ++i)
+    desc[(prod + i) & sock->fill.mask] = addrs[i];
+
+  __atomic_store_n(sock->fill.producer, prod + n, __ATOMIC_RELEASE);
+
+  unlock_fill(sock);
+}
+
+/**
+ * Creates socket with UMEM and its rings, binds it to receive queue
+ * and fills the whole UMEM into fill ring. Zero copy is tried only in
+ * native mode, generic mode always copies.
+ */
+static InitRT
+open_socket(struct Socket *sock, int ifindex, unsigned int queue, int native)
+{
+  sock->fd = socket(AF_XDP, SOCK_RAW, 0);
+  if (sock->fd < 0)
+    return error("socket");
+
+  size_t umem_size = (size_t)frames * frame_size;
+  sock->umem = mmap(NULL, umem_size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  if (sock->umem == MAP_FAILED)
+    return error("mmap");
+
+  sock->pending = calloc(frames, sizeof(*sock->pending));
+  if (!sock->pending)
+    return error("calloc");
+
+  struct xdp_umem_reg reg = {0};
+  reg.addr = (uintptr_t)sock->umem;
+  reg.len = umem_size;
+  reg.chunk_size = frame_size;
+
+  if (setsockopt(sock->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)))
+    return error("XDP_UMEM_REG");
+
+  unsigned int completion = COMPLETION_SIZE;
+  if (setsockopt(sock->fd, SOL_XDP, XDP_UMEM_FILL_RING, &frames,
+        sizeof(frames))
+      || setsockopt(sock->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &completion,
+        sizeof(completion))
+      || setsockopt(sock->fd, SOL_XDP, XDP_RX_RING, &frames, sizeof(frames)))
+    return error("XDP ring size");
+
+  struct xdp_mmap_offsets off;
+  socklen_t len = sizeof(off);
+  if (getsockopt(sock->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &len))
+    return error("XDP_MMAP_OFFSETS");
+
+  if (!map_ring(&sock->fill, sock->fd, &off.fr, frames, sizeof(uint64_t),
+        XDP_UMEM_PGOFF_FILL_RING)
+      || !map_ring(&sock->rx, sock->fd, &off.rx, frames,
+        sizeof(struct xdp_desc), XDP_PGOFF_RX_RING))
+    return error("mmap ring");
+
+  struct sockaddr_xdp addr = {0};
+  addr.sxdp_family = AF_XDP;
+  addr.sxdp_ifindex = ifindex;
+  addr.sxdp_queue_id = queue;
+  addr.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_ZEROCOPY;
+
+  if (!native || bind(sock->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    addr.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_COPY;
+
+    /* Queue stays busy for a while after previous socket was closed */
+    int retries = BIND_RETRIES;
+    while (bind(sock->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+      if (errno != EBUSY || !retries--)
+        return error("bind");
+      usleep(BIND_RETRY_USEC);
+    }
+  }
+
+  for (unsigned int i = 0; i < frames; ++i)
+    sock->pending[i] = (uint64_t)i * frame_size;
+  fill_frames(sock, sock->pending, frames);
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+/**
+ * Loads XDP program redirecting every packet to socket of its receive
+ * queue. Packets of queues without socket are passed to kernel stack.
+ */
+static int
+load_program()
+{
+  struct bpf_insn insns[] = {
+    /* r2 = ctx->rx_queue_index */
+    {BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1,
+      offsetof(struct xdp_md, rx_queue_index), 0},
+    /* r1 = xsk map */
+    {BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd},
+    {0, 0, 0, 0, 0},
+    /* r3 = action if map has no socket for queue */
+    {BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS},
+    {BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map},
+    {BPF_JMP | BPF_EXIT, 0, 0, 0, 0},
+  };
+
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns = (uintptr_t)insns;
+  attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+  attr.license = (uintptr_t)"GPL";
+
+  prog_fd = sys_bpf(BPF_PROG_LOAD, &attr);
+  return prog_fd >= 0;
+}
+
+/**
+ * Attaches program to interface by BPF link, so it is detached when
+ * the link is closed, even if the process dies.
+ */
+static int
+attach_program(int ifindex, unsigned int flags)
+{
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.link_create.prog_fd = prog_fd;
+  attr.link_create.target_ifindex = ifindex;
+  attr.link_create.attach_type = BPF_XDP;
+  attr.link_create.flags = flags;
+
+  link_fd = sys_bpf(BPF_LINK_CREATE, &attr);
+  return link_fd >= 0;
+}
+
+InitRT
+init(const char *arg)
+{
+  char iface[IFNAMSIZ];
+
+  for (unsigned int i = 0; i < MAX_QUEUES; ++i)
+    sockets[i] = (struct Socket){-1, MAP_FAILED};
+
+  if (!parse_arg(arg, iface))
+    return (InitRT){RESULT_ERROR, "Invalid plugin argument"};
+
+  int ifindex = if_nametoindex(iface);
+  if (!ifindex)
+    return error(iface);
+
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_type = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size = sizeof(uint32_t);
+  attr.value_size = sizeof(int);
+  attr.max_entries = first_queue + socket_count;
+
+  map_fd = sys_bpf(BPF_MAP_CREATE, &attr);
+  if (map_fd < 0)
+    return error("BPF_MAP_CREATE");
+
+  if (!load_program())
+    return error("BPF_PROG_LOAD");
+
+  /* Program is attached first to find out whether driver supports native
+   * mode, sockets then try zero copy only with native driver */
+  int native = mode != MODE_SKB && attach_program(ifindex, XDP_FLAGS_DRV_MODE);
+  if (!native && (mode == MODE_NATIVE
+        || !attach_program(ifindex, XDP_FLAGS_SKB_MODE)))
+    return error("BPF_LINK_CREATE");
+
+  for (unsigned int i = 0; i < socket_count; ++i) {
+    struct Socket *sock = &sockets[i];
+    uint32_t queue = first_queue + i;
+
+    InitRT result = open_socket(sock, ifindex, queue, native);
+    if (result.type != RESULT_OK)
+      return result;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = map_fd;
+    attr.key = (uintptr_t)&queue;
+    attr.value = (uintptr_t)&sock->fd;
+
+    if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr))
+      return error("BPF_MAP_UPDATE_ELEM");
+  }
+
+  return (InitRT){RESULT_OK, ""};
+}
+
+static void
+unmap_ring(struct Ring *ring)
+{
+  if (ring->map && ring->map != MAP_FAILED)
+    munmap(ring->map, ring->map_len);
+}
+
+FinalizeRT
+finalize()
+{
+  /* Detach program first, so no packets are redirected to closed sockets */
+  if (link_fd >= 0)
+    close(link_fd);
+
+  if (prog_fd >= 0)
+    close(prog_fd);
+
+  if (map_fd >= 0)
+    close(map_fd);
+
+  for (unsigned int i = 0; i < MAX_QUEUES; ++i) {
+    struct Socket *sock = &sockets[i];
+
+    unmap_ring(&sock->fill);
+    unmap_ring(&sock->rx);
+
+    if (sock->fd >= 0)
+      close(sock->fd);
+
+    if (sock->umem != MAP_FAILED)
+      munmap(sock->umem, (size_t)frames * frame_size);
+
+    free(sock->pending);
+  }
+}
+
+QueueCountRT
+queue_count()
+{
+  return socket_count;
+}
+
+/**
+ * Waits for descriptors in receive ring. Poll also wakes up driver
+ * when kernel asks for it by need wakeup flag.
+ * @return Number of descriptors ready to be consumed.
+ */
+static unsigned int
+ready(struct Socket *sock, enum GetPacketResultType *type)
+{
+  uint32_t cons = *sock->rx.consumer;
+  uint32_t prod = __atomic_load_n(sock->rx.producer, __ATOMIC_ACQUIRE);
+
+  if (prod == cons) {
+    struct pollfd pfd = {sock->fd, POLLIN, 0};
+
+    if (poll(&pfd, 1, timeout) < 0 && errno != EINTR) {
+      *type = CAPTURE_INPUT_ERROR;
+      return 0;
+    }
+
+    prod = __atomic_load_n(sock->rx.producer, __ATOMIC_ACQUIRE);
+  }
+
+  *type = prod == cons ? CAPTURE_TIMEOUT : CAPTURE_PACKET;
+  return prod - cons;
+}
+
+/**
+ * Consumes up to max descriptors of receive ring. Frame addresses are
+ * stored to addrs, frames stay owned by plugin until they are filled back.
+ * AF_XDP has no capture timestamps, whole batch gets time of its receipt.
+ */
+static GetPacketsRT
+receive(struct Socket *sock, struct Packet *out, uint64_t *addrs,
+    unsigned int max)
+{
+  enum GetPacketResultType type;
+  unsigned int count = ready(sock, &type);
+  if (!count)
+    return (GetPacketsRT){type, 0};
+
+  if (count > max)
+    count = max;
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  const struct xdp_desc *desc = sock->rx.desc;
+  uint32_t cons = *sock->rx.consumer;
+
+  for (unsigned int i = 0; i < count; ++i) {
+    const struct xdp_desc *d = &desc[(cons + i) & sock->rx.mask];
+
+    out[i] = (struct Packet){
+      sock->umem + d->addr,
+      d->len,
+      d->len,
+      now.tv_sec,
+      now.tv_nsec / 1000
+    };
+    addrs[i] = d->addr & ~(uint64_t)(frame_size - 1);
+  }
+
+  __atomic_store_n(sock->rx.consumer, cons + count, __ATOMIC_RELEASE);
+  sock->received += count;
+
+  return (GetPacketsRT){CAPTURE_PACKET, count};
+}
+
+/**
+ * Function get packets returns frames of the previous batch to kernel
+ * and consumes a new batch, so the batch stays valid until the next call.
+ */
+GetPacketsRT
+get_packets_q(unsigned int queue, struct Packet *out, unsigned int max)
+{
+  struct Socket *sock = &sockets[queue];
+
+  if (sock->pending_count) {
+    fill_frames(sock, sock->pending, sock->pending_count);
+    sock->pending_count = 0;
+  }
+
+  GetPacketsRT result = receive(sock, out, sock->pending, max);
+  sock->pending_count = result.count;
+
+  return result;
+}
+
+GetPacketRT
+get_packet_q(unsigned int queue)
+{
+  struct Packet packet;
+
+  GetPacketsRT result = get_packets_q(queue, &packet, 1);
+  if (result.type != CAPTURE_PACKET)
+    return (GetPacketRT){result.type, {}};
+
+  return (GetPacketRT){CAPTURE_PACKET, packet};
+}
+
+/**
+ * Function lease packets hands frames out until they are released. Handle
+ * encodes both socket and frame address.
+ */
+GetPacketsRT
+lease_packets_q(unsigned int queue, struct LeasedPacket *out,
+    unsigned int max)
+{
+  struct Socket *sock = &sockets[queue];
+  struct Packet packets[max];
+  uint64_t addrs[max];
+
+  GetPacketsRT result = receive(sock, packets, addrs, max);
+
+  uintptr_t base = (uintptr_t)queue * frames * frame_size;
+  for (unsigned int i = 0; i < result.count; ++i)
+    out[i] = (struct LeasedPacket){packets[i], (void *)(base + addrs[i] + 1)};
+
+  return result;
+}
+
+GetPacketRT
+get_packet()
+{
+  return get_packet_q(0);
+}
+
+GetPacketsRT
+get_packets(struct Packet *out, unsigned int max)
+{
+  return get_packets_q(0, out, max);
+}
+
+GetPacketsRT
+lease_packets(struct LeasedPacket *out, unsigned int max)
+{
+  return lease_packets_q(0, out, max);
+}
+
+/**
+ * Function release packets fills leased frames back to kernel. Runs of
+ * handles of the same socket are filled at once. It can be called from
+ * any thread.
+ */
+ReleasePacketsRT
+release_packets(void *const *handles, unsigned int n)
+{
+  size_t umem_size = (size_t)frames * frame_size;
+  uint64_t addrs[64];
+  unsigned int count = 0;
+  unsigned int queue = 0;
+
+  for (unsigned int i = 0; i < n; ++i) {
+    uintptr_t handle = (uintptr_t)handles[i] - 1;
+    unsigned int next = handle / umem_size;
+
+    if (count && (next != queue || count == sizeof(addrs) / sizeof(addrs[0]))) {
+      fill_frames(&sockets[queue], addrs, count);
+      count = 0;
+    }
+
+    queue = next;
+    addrs[count++] = handle % umem_size;
+  }
+
+  if (count)
+    fill_frames(&sockets[queue], addrs, count);
+}
+
+/**
+ * Function statistics returns packets received by sockets together with
+ * packets kernel dropped because receive ring was full or for other
+ * reasons. Kernel counters are not reset on read.
+ */
+StatisticsRT
+statistics()
+{
+  struct Statistics total = {0, 0};
+
+  for (unsigned int i = 0; i < socket_count; ++i) {
+    struct Socket *sock = &sockets[i];
+    struct xdp_statistics kstats;
+    socklen_t len = sizeof(kstats);
+
+    uint64_t drops = 0;
+    if (!getsockopt(sock->fd, SOL_XDP, XDP_STATISTICS, &kstats, &len))
+      drops = kstats.rx_dropped + kstats.rx_ring_full
+        + kstats.rx_invalid_descs;
+
+    total.packets += sock->received + drops;
+    total.drops += drops;
+  }
+
+  return total;
+}
@@ -0,0 +1,346 @@
+#include <batch.hpp>
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <log.hpp>
+
+namespace Parser {
+
+/* Multipliers of digest, odd constants of murmur and xxhash */
+static constexpr std::uint32_t DIGEST_SRC = 0x9e3779b1;
+static constexpr std::uint32_t DIGEST_DST = 0x85ebca77;
+static constexpr std::uint32_t DIGEST_PORTS = 0xc2b2ae3d;
+static constexpr std::uint32_t DIGEST_PROTOCOL = 0x27d4eb2f;
+static constexpr std::uint32_t DIGEST_MIX = 0x2c1b3c6d;
+
+static constexpr std::uint16_t ETHERTYPE_IP = 0x0800;
+static constexpr std::uint16_t ETHERTYPE_VLAN = 0x8100;
+static constexpr std::uint8_t PROTOCOL_TCP = 6;
+static constexpr std::uint8_t PROTOCOL_UDP = 17;
+
+/* Shortest simple packet, Ethernet, IPv4 and UDP */
+static constexpr std::uint32_t MIN_SIMPLE = 14 + 20 + 8;
+
+std::uint32_t
+digest(std::uint32_t src, std::uint32_t dst, std::uint8_t protocol,
+    std::uint16_t sport, std::uint16_t dport)
+{
+  auto ports = std::uint32_t{sport} << 16 | dport;
+  auto h = src * DIGEST_SRC ^ dst * DIGEST_DST ^ ports * DIGEST_PORTS
+    ^ protocol * DIGEST_PROTOCOL;
+
+  h ^= h >> 15;
+  h *= DIGEST_MIX;
+  h ^= h >> 13;
+  return h | 1;
+}
+
+static std::uint32_t
+read32(const std::uint8_t* data)
+{
+  std::uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+void
+extract_scalar(const Packet* packets, std::size_t count, Columns& columns)
+{
+  for (std::size_t i = 0; i < count; ++i) {
+    const auto* data = packets[i].data;
+    const auto size = packets[i].caplen;
+    columns.simple[i] = false;
+
+    if (size < MIN_SIMPLE)
+      continue;
+
+    auto ethertype = std::uint16_t(data[12] << 8 | data[13]);
+    auto vlan = ethertype == ETHERTYPE_VLAN;
+    std::uint32_t network = vlan ? 18 : 14;
+    auto inner = vlan ? std::uint16_t(data[16] << 8 | data[17]) : ethertype;
+
+    if (inner != ETHERTYPE_IP)
+      continue;
+
+    /* Headers are validated by the checks of parse(), so packets it would
+     * drop are left to it to be counted */
+    const auto* ip = data + network;
+    std::uint32_t ip_size;
+    if (ipv4_header(ip, size - network, ip_size) != Error::NONE)
+      continue;
+
+    if ((ip[6] << 8 | ip[7]) & 0x3fff)
+      continue;
+
+    std::uint32_t transport = network + ip_size;
+    std::uint32_t transport_size = 8;
+    if (ip[9] == PROTOCOL_TCP) {
+      if (tcp_header(data + transport, size - transport, transport_size)
+          != Error::NONE)
+        continue;
+    } else if (ip[9] != PROTOCOL_UDP || size - transport < transport_size) {
+      continue;
+    }
+
+    columns.simple[i] = true;
+    columns.ethertype[i] = ethertype;
+    columns.vlan[i] = vlan ? (data[14] << 8 | data[15]) & 0x0fff : 0;
+    columns.src[i] = read32(ip + 12);
+    columns.dst[i] = read32(ip + 16);
+    columns.protocol[i] = ip[9];
+    columns.sport[i] = data[transport] << 8 | data[transport + 1];
+    columns.dport[i] = data[transport + 2] << 8 | data[transport + 3];
+    columns.network[i] = network;
+    columns.transport[i] = transport;
+    columns.transport_size[i] = transport_size;
+    columns.digest[i] = digest(columns.src[i], columns.dst[i],
+        columns.protocol[i], columns.sport[i], columns.dport[i]);
+  }
+}
+
+#if defined(__x86_64__)
+
+static constexpr std::size_t LANES = 8;
+
+/**
+ * Gathers 32 bits at offset of every lane's packet, lanes out of mask
+ * are not read and are zero.
+ */
+__attribute__((target("avx2")))
+static __m256i
+gather(__m256i lo, __m256i hi, __m256i offset, __m256i mask)
+{
+  auto offset_lo = _mm256_cvtepu32_epi64(_mm256_castsi256_si128(offset));
+  auto offset_hi = _mm256_cvtepu32_epi64(_mm256_extracti128_si256(offset, 1));
+
+  auto values_lo = _mm256_mask_i64gather_epi32(_mm_setzero_si128(),
+      static_cast<const int*>(nullptr), _mm256_add_epi64(lo, offset_lo),
+      _mm256_castsi256_si128(mask), 1);
+  auto values_hi = _mm256_mask_i64gather_epi32(_mm_setzero_si128(),
+      static_cast<const int*>(nullptr), _mm256_add_epi64(hi, offset_hi),
+      _mm256_extracti128_si256(mask, 1), 1);
+
+  return _mm256_set_m128i(values_hi, values_lo);
+}
+
+/* Converts gathered network order words to host order */
+__attribute__((target("avx2")))
+static __m256i
+bswap(__m256i value)
+{
+  const auto order = _mm256_setr_epi8(
+      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  return _mm256_shuffle_epi8(value, order);
+}
+
+/* Lanes where size is at least minimum */
+__attribute__((target("avx2")))
+static __m256i
+fits(__m256i size, __m256i minimum)
+{
+  return _mm256_cmpgt_epi32(size, _mm256_sub_epi32(minimum,
+        _mm256_set1_epi32(1)));
+}
+
+__attribute__((target("avx2")))
+static void
+extract_avx2(const Packet* packets, std::size_t count, Columns& columns,
+    std::size_t first)
+{
+  alignas(32) std::uint64_t pointers[LANES] = {};
+  alignas(32) std::uint32_t sizes[LANES] = {};
+  for (std::size_t i = 0; i < count; ++i) {
+    pointers[i] = reinterpret_cast<std::uint64_t>(packets[i].data);
+    sizes[i] = packets[i].caplen;
+  }
+
+  const auto lo = _mm256_load_si256(reinterpret_cast<__m256i*>(pointers));
+  const auto hi = _mm256_load_si256(reinterpret_cast<__m256i*>(pointers + 4));
+  const auto size = _mm256_load_si256(reinterpret_cast<__m256i*>(sizes));
+
+  auto mask = fits(size, _mm256_set1_epi32(MIN_SIMPLE));
+
+  /* Ethertype, VLAN id and ethertype after tag */
+  auto word = bswap(gather(lo, hi, _mm256_set1_epi32(12), mask));
+  auto ethertype = _mm256_srli_epi32(word, 16);
+  auto vlan_id = _mm256_and_si256(word, _mm256_set1_epi32(0x0fff));
+  auto vlan = _mm256_cmpeq_epi32(ethertype, _mm256_set1_epi32(ETHERTYPE_VLAN));
+  auto inner = _mm256_srli_epi32(bswap(gather(lo, hi, _mm256_set1_epi32(16),
+          _mm256_and_si256(mask, vlan))), 16);
+  inner = _mm256_blendv_epi8(ethertype, inner, vlan);
+  vlan_id = _mm256_and_si256(vlan_id, vlan);
+
+  auto network = _mm256_add_epi32(_mm256_set1_epi32(14),
+      _mm256_and_si256(vlan, _mm256_set1_epi32(4)));
+  mask = _mm256_and_si256(mask,
+      _mm256_cmpeq_epi32(inner, _mm256_set1_epi32(ETHERTYPE_IP)));
+  mask = _mm256_and_si256(mask,
+      fits(size, _mm256_add_epi32(network, _mm256_set1_epi32(20))));
+
+  /* Version, IHL, fragment offset and protocol of IPv4 header */
+  word = bswap(gather(lo, hi, network, mask));
+  auto version = _mm256_srli_epi32(word, 28);
+  auto ihl = _mm256_and_si256(_mm256_srli_epi32(word, 24),
+      _mm256_set1_epi32(0x0f));
+  mask = _mm256_and_si256(mask,
+      _mm256_cmpeq_epi32(version, _mm256_set1_epi32(4)));
+  mask = _mm256_and_si256(mask, _mm256_cmpgt_epi32(ihl, _mm256_set1_epi32(4)));
+
+  word = bswap(gather(lo, hi, _mm256_add_epi32(network, _mm256_set1_epi32(4)),
+        mask));
+  mask = _mm256_and_si256(mask, _mm256_cmpeq_epi32(
+        _mm256_and_si256(word, _mm256_set1_epi32(0x3fff)),
+        _mm256_setzero_si256()));
+
+  word = bswap(gather(lo, hi, _mm256_add_epi32(network, _mm256_set1_epi32(8)),
+        mask));
+  auto protocol = _mm256_and_si256(_mm256_srli_epi32(word, 16),
+      _mm256_set1_epi32(0xff));
+  auto tcp = _mm256_cmpeq_epi32(protocol, _mm256_set1_epi32(PROTOCOL_TCP));
+  auto udp = _mm256_cmpeq_epi32(protocol, _mm256_set1_epi32(PROTOCOL_UDP));
+  mask = _mm256_and_si256(mask, _mm256_or_si256(tcp, udp));
+
+  auto src = gather(lo, hi, _mm256_add_epi32(network, _mm256_set1_epi32(12)),
+      mask);
+  auto dst = gather(lo, hi, _mm256_add_epi32(network, _mm256_set1_epi32(16)),
+      mask);
+
+  /* Ports and size of transport header */
+  auto transport = _mm256_add_epi32(network, _mm256_slli_epi32(ihl, 2));
+  mask = _mm256_and_si256(mask,
+      fits(size, _mm256_add_epi32(transport, _mm256_set1_epi32(8))));
+  auto ports = bswap(gather(lo, hi, transport, mask));
+
+  auto tcp_mask = _mm256_and_si256(_mm256_and_si256(mask, tcp),
+      fits(size, _mm256_add_epi32(transport, _mm256_set1_epi32(20))));
+  word = bswap(gather(lo, hi,
+        _mm256_add_epi32(transport, _mm256_set1_epi32(12)), tcp_mask));
+  auto transport_size = _mm256_blendv_epi8(_mm256_set1_epi32(8),
+      _mm256_slli_epi32(_mm256_srli_epi32(word, 28), 2), tcp);
+  auto valid_tcp = _mm256_and_si256(tcp_mask, _mm256_and_si256(
+        _mm256_cmpgt_epi32(transport_size, _mm256_set1_epi32(19)),
+        fits(size, _mm256_add_epi32(transport, transport_size))));
+  mask = _mm256_or_si256(_mm256_and_si256(mask, udp), valid_tcp);
+
+  /* Digest of 5-tuple, the same as digest() */
+  auto h = _mm256_xor_si256(
+      _mm256_xor_si256(
+        _mm256_mullo_epi32(src, _mm256_set1_epi32(DIGEST_SRC)),
+        _mm256_mullo_epi32(dst, _mm256_set1_epi32(DIGEST_DST))),
+      _mm256_xor_si256(
+        _mm256_mullo_epi32(ports, _mm256_set1_epi32(DIGEST_PORTS)),
+        _mm256_mullo_epi32(protocol, _mm256_set1_epi32(DIGEST_PROTOCOL))));
+  h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+  h = _mm256_mullo_epi32(h, _mm256_set1_epi32(DIGEST_MIX));
+  h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 13));
+  h = _mm256_or_si256(h, _mm256_set1_epi32(1));
+
+  alignas(32) std::uint32_t lanes[11][LANES];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[0]), mask);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[1]), ethertype);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[2]), vlan_id);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[3]), src);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[4]), dst);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[5]), protocol);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[6]), ports);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[7]), network);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[8]), transport);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[9]), transport_size);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[10]), h);
+
+  for (std::size_t i = 0; i < count; ++i) {
+    auto c = first + i;
+    columns.simple[c] = lanes[0][i] != 0;
+    columns.ethertype[c] = lanes[1][i];
+    columns.vlan[c] = lanes[2][i];
+    columns.src[c] = lanes[3][i];
+    columns.dst[c] = lanes[4][i];
+    columns.protocol[c] = lanes[5][i];
+    columns.sport[c] = lanes[6][i] >> 16;
+    columns.dport[c] = lanes[6][i] & 0xffff;
+    columns.network[c] = lanes[7][i];
+    columns.transport[c] = lanes[8][i];
+    columns.transport_size[c] = lanes[9][i];
+    columns.digest[c] = lanes[10][i];
+  }
+}
+
+static bool
+use_avx2()
+{
+  static const bool avx2 = []() {
+    bool supported = __builtin_cpu_supports("avx2");
+    Log::debug("Header extraction uses %s\n",
+        supported ? "AVX2" : "scalar code");
+    return supported;
+  }();
+  return avx2;
+}
+
+#endif
+
+void
+extract(const Packet* packets, std::size_t count, Columns& columns)
+{
+#if defined(__x86_64__)
+  if (use_avx2()) {
+    for (std::size_t i = 0; i < count; i += LANES) {
+      auto lanes = count - i < LANES ? count - i : LANES;
+      extract_avx2(packets + i, lanes, columns, i);
+    }
+  } else {
+    extract_scalar(packets, count, columns);
+  }
+#else
+  extract_scalar(packets, count, columns);
+#endif
+
+  /* Packet is parsed by fast path if its layers are not all parsed or UDP
+   * payload is parsed too */
+  const auto ip = descends(Tins::PDU::PDUType::ETHERNET_II)
+    && descends(Tins::PDU::PDUType::IP);
+  const auto vlan = descends(Tins::PDU::PDUType::DOT1Q);
+
+  for (std::size_t i = 0; i < count; ++i) {
+    if (!columns.simple[i])
+      continue;
+
+    if (!ip || (!vlan && columns.ethertype[i] == ETHERTYPE_VLAN)
+        || (columns.protocol[i] == PROTOCOL_UDP
+          && parses_udp_payload(columns.dport[i])))
+      columns.simple[i] = false;
+  }
+}
+
+void
+fill(const Columns& columns, std::size_t i, const std::uint8_t* data,
+    Layers& layers)
+{
+  auto add = [&layers](Tins::PDU::PDUType type, std::uint32_t offset,
+      std::uint32_t size) {
+    layers.layers[layers.count++] = Layer{type,
+      static_cast<std::uint16_t>(offset), static_cast<std::uint16_t>(size)};
+  };
+
+  const auto network = columns.network[i];
+  const auto transport = columns.transport[i];
+  const auto transport_size = columns.transport_size[i];
+
+  layers.count = 0;
+  add(Tins::PDU::PDUType::ETHERNET_II, 0, 14);
+  if (columns.ethertype[i] == ETHERTYPE_VLAN)
+    add(Tins::PDU::PDUType::DOT1Q, 14, 4);
+  add(Tins::PDU::PDUType::IP, network, transport - network);
+  add(columns.protocol[i] == PROTOCOL_TCP
+      ? Tins::PDU::PDUType::TCP : Tins::PDU::PDUType::UDP,
+      transport, transport_size);
+
+  std::memcpy(layers.headers.data(), data, transport + transport_size);
+}
+
+} // namespace Parser
@@ -10,10 +10,12 @@ tsgeq(timeval f, timeval s)
 }
 
 void
-Cache::update_record(Cache::iterator it, timeval ts)
+Cache::update_record(Cache::iterator it, timeval ts, std::size_t packets,
+    std::size_t octets)
 {
     auto& [props, _] = it->second;
-    props.count += 1;
+    props.count += packets;
+    props.octets += octets;
 
     if (tsgeq(props.flow_start, ts)) {
       props.flow_start = ts;
@@ -24,17 +26,33 @@ Cache::update_record(Cache::iterator it, timeval ts)
 }
 
 Cache::iterator
-Cache::insert_record(std::size_t digest, timeval ts, Buffer values)
+Cache::find_record(std::size_t hash, std::uint32_t interface,
+    const Buffer& values)
 {
-  auto search = find(digest);
+  auto [first, last] = equal_range(hash);
+
+  for (auto it = first; it != last; ++it) {
+    const auto& [props, entry_values] = it->second;
+
+    if (props.interface == interface && entry_values == values)
+      return it;
+  }
+
+  return end();
+}
+
+Cache::iterator
+Cache::insert_record(std::size_t hash, timeval ts, std::uint32_t interface,
+    std::size_t packets, std::size_t octets, Buffer values)
+{
+  auto search = find_record(hash, interface, values);
   if (search == end()) {
     /* If this record is new add it to cache */
-    auto [it, _] = emplace(digest, CacheEntry{{1, ts, ts}, std::move(values)});
-
-    return it;
+    return emplace(hash,
+        CacheEntry{{packets, octets, ts, ts, interface}, std::move(values)});
   } else {
     /* If this record already exists update counter */
-    update_record(search, ts);
+    update_record(search, ts, packets, octets);
 
     return search;
   }
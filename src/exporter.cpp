@@ -25,13 +25,18 @@ struct [[gnu::packed]] TemplateHeader {
   std::uint16_t field_count;
 };
 
+/* Size of values of flow template preceding the list, without interface */
+static constexpr std::size_t PROPERTIES_SIZE = 41;
+
 static Buffer
-prepare_flow_template()
+prepare_flow_template(bool interfaces)
 {
   auto result = Buffer{};
 
   result.push_back_any<std::uint16_t>(htons(IPFIX::FIELD_PACKET_DELTA_COUNT));
   result.push_back_any<std::uint16_t>(htons(IPFIX::TYPE_64));
+  result.push_back_any<std::uint16_t>(htons(IPFIX::FIELD_LAYER2_OCTET_DELTA_COUNT));
+  result.push_back_any<std::uint16_t>(htons(IPFIX::TYPE_64));
   result.push_back_any<std::uint16_t>(htons(IPFIX::FIELD_FLOW_START_SECONDS));
   result.push_back_any<std::uint16_t>(htons(IPFIX::TYPE_SECONDS));
   result.push_back_any<std::uint16_t>(htons(IPFIX::FIELD_FLOW_END_SECONDS));
@@ -42,6 +47,10 @@ prepare_flow_template()
   result.push_back_any<std::uint16_t>(htons(IPFIX::TYPE_MILLISECONDS));
   result.push_back_any<std::uint16_t>(htons(IPFIX::FIELD_FLOW_END_REASON));
   result.push_back_any<std::uint16_t>(htons(IPFIX::TYPE_8));
+  if (interfaces) {
+    result.push_back_any<std::uint16_t>(htons(IPFIX::FIELD_INGRESS_INTERFACE));
+    result.push_back_any<std::uint16_t>(htons(IPFIX::TYPE_32));
+  }
   result.push_back_any<std::uint16_t>(htons(IPFIX::FIELD_SUB_TEMPLATE_MULTI_LIST));
   result.push_back_any<std::uint16_t>(htons(IPFIX::TYPE_LIST));
 
@@ -52,9 +61,21 @@ Exporter::Exporter(const std::string& address, std::uint16_t port)
   : _conn(Net::Connection::tcp(address, port))
 {
   _buffer.reserve(BUFFER_SIZE);
-  _buffer.push_back_any<MessageHeader>({});
+  set_interfaces(false);
+}
+
+/**
+ * Sets whether records carry ingress interface and writes flow template
+ * accordingly. Must be called before any template or record is inserted.
+ */
+void
+Exporter::set_interfaces(bool interfaces)
+{
+  _interfaces = interfaces;
 
-  copy_template(FLOW_TEMPLATE, prepare_flow_template());
+  _buffer.clear();
+  _buffer.push_back_any<MessageHeader>({});
+  copy_template(FLOW_TEMPLATE, prepare_flow_template(interfaces));
 }
 
 std::uint16_t
@@ -99,16 +120,20 @@ void
 Exporter::insert_record(
     const IPFIX::Properties& props, std::uint8_t reason, Buffer values)
 {
+  auto properties_size = PROPERTIES_SIZE
+    + (_interfaces ? sizeof(std::uint32_t) : 0);
+
   if (_buffer.capacity() - _buffer.size() 
-      < values.size() + 33 + sizeof(RecordHeader))
+      < values.size() + properties_size + sizeof(RecordHeader))
     flush();
 
   _buffer.push_back_any<RecordHeader>({
       htons(FLOW_TEMPLATE),
-      htons(sizeof(RecordHeader) + 33 + values.size())
+      htons(sizeof(RecordHeader) + properties_size + values.size())
       });
 
   _buffer.push_back_any<std::uint64_t>(htonT(props.count));
+  _buffer.push_back_any<std::uint64_t>(htonT(props.octets));
   _buffer.push_back_any<std::uint32_t>(htonl(props.flow_start.tv_sec));
   _buffer.push_back_any<std::uint32_t>(htonl(props.flow_end.tv_sec));
   _buffer.push_back_any<std::uint64_t>(
@@ -116,6 +141,8 @@ Exporter::insert_record(
   _buffer.push_back_any<std::uint64_t>(
       htonT(props.flow_end.tv_sec * 1000 + props.flow_end.tv_usec / 1000));
   _buffer.push_back_any<std::uint8_t>(reason);
+  if (_interfaces)
+    _buffer.push_back_any<std::uint32_t>(htonl(props.interface));
 
   _buffer.insert(_buffer.end(), values.begin(), values.end());
 
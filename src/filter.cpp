@@ -0,0 +1,55 @@
+#include <filter.hpp>
+
+#include <stdexcept>
+#include <string>
+
+namespace Plugins {
+
+/* Longest packet compiled filter may be given */
+static constexpr int MAX_SNAPLEN = 0xFFFF;
+
+Filter::Filter(const CaptureOptions& options)
+  : _snaplen(options.snaplen)
+{
+  if (*options.filter == '\0')
+    return;
+
+  auto* dead = pcap_open_dead(DLT_EN10MB, MAX_SNAPLEN);
+  if (dead == nullptr)
+    throw std::runtime_error{"Cannot compile capture filter"};
+
+  if (pcap_compile(dead, &_program, options.filter, 1,
+        PCAP_NETMASK_UNKNOWN)) {
+    auto error = std::string{pcap_geterr(dead)};
+    pcap_close(dead);
+    throw std::runtime_error{error};
+  }
+
+  pcap_close(dead);
+}
+
+Filter::~Filter() noexcept
+{
+  if (_program.bf_insns != nullptr)
+    pcap_freecode(&_program);
+}
+
+bool
+Filter::apply(Packet& packet) const
+{
+  if (_program.bf_insns != nullptr) {
+    auto header = pcap_pkthdr{};
+    header.caplen = packet.caplen;
+    header.len = packet.len;
+
+    if (pcap_offline_filter(&_program, &header, packet.data) == 0)
+      return false;
+  }
+
+  if (_snaplen != 0 && packet.caplen > _snaplen)
+    packet.caplen = _snaplen;
+
+  return true;
+}
+
+} // namespace Plugins
@@ -35,7 +35,8 @@ load_plugins(const std::string& dir)
 }
 
 Input
-create_input(const std::string& name, const char* arg)
+create_input(const std::string& name, const char* arg,
+    const CaptureOptions& capture)
 {
   Log::debug("Creating plugin %s\n", name.c_str());
 
@@ -43,7 +44,7 @@ create_input(const std::string& name, const char* arg)
   if (search == inputs.end())
     throw std::runtime_error{"Input is not loaded"};
   
-  auto input = Input{std::move(search->second), arg};
+  auto input = Input{std::move(search->second), arg, capture};
   inputs.erase(search);
 
   return input;
@@ -17,7 +17,9 @@ static auto app_options = Options{
   120,
   15,
   "127.0.0.1",
-  4'739
+  4'739,
+  "",
+  0
 };
 
 static auto config_file = toml::value{};
@@ -117,6 +119,12 @@ merge_file(const std::string& path)
       app_options.port);
   app_options.plugins_dir = toml::find_or(config_file, "plugins_dir",
       app_options.plugins_dir);
+
+  /* Capture options applied by input plugin */
+  app_options.filter = toml::find_or(config_file, "filter",
+      app_options.filter);
+  app_options.snaplen = toml::find_or(config_file, "snaplen",
+      app_options.snaplen);
 }
 
 void
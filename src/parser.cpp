@@ -1,15 +1,149 @@
 #include <parser.hpp>
 
+#include <array>
+#include <cstring>
 #include <unordered_map>
 
+#include <netinet/in.h>
+
+#include <tins/constants.h>
+
+#include <protocols/gre.hpp>
+#include <protocols/vxlan.hpp>
+#include <protocols/geneve.hpp>
+#include <protocols/gtp.hpp>
+
 namespace Parser {
 
-static std::unordered_map<std::uint16_t, ParserFun> udp_parsers;
+struct UdpParser {
+  Tins::PDU::PDUType type;
+  ParserFun parse;
+};
+
+static std::unordered_map<std::uint16_t, UdpParser> udp_parsers;
 
 void
-insert_udp_parser(std::uint16_t port, ParserFun f)
+insert_udp_parser(std::uint16_t port, Tins::PDU::PDUType type, ParserFun f)
 {
-  udp_parsers.emplace(port, f);
+  udp_parsers.emplace(port, UdpParser{type, f});
+}
+
+/* Layers known to fast path, indexes into tables of layers */
+enum LayerIndex : std::uint8_t {
+  ETHERNET, DOT1Q, MPLS, IP, IPV6, TCP, UDP, GRE, VXLAN, GENEVE, GTP,
+  LAYER_COUNT
+};
+
+static constexpr std::array<Tins::PDU::PDUType, LAYER_COUNT> layer_types = {
+  Tins::PDU::PDUType::ETHERNET_II, Tins::PDU::PDUType::DOT1Q,
+  Tins::PDU::PDUType::MPLS, Tins::PDU::PDUType::IP,
+  Tins::PDU::PDUType::IPv6, Tins::PDU::PDUType::TCP,
+  Tins::PDU::PDUType::UDP, Protocols::GREPDU_TYPE, Protocols::VXLANPDU_TYPE,
+  Protocols::GENEVEPDU_TYPE, Protocols::GTPPDU_TYPE,
+};
+
+/* Layers that may directly follow each layer */
+static constexpr std::array<std::uint32_t, LAYER_COUNT> inner_layers = {
+  1u << DOT1Q | 1u << MPLS | 1u << IP | 1u << IPV6,
+  1u << DOT1Q | 1u << MPLS | 1u << IP | 1u << IPV6,
+  1u << MPLS | 1u << IP | 1u << IPV6,
+  1u << TCP | 1u << UDP | 1u << GRE | 1u << IP | 1u << IPV6,
+  1u << TCP | 1u << UDP | 1u << GRE | 1u << IP | 1u << IPV6,
+  0,
+  1u << VXLAN | 1u << GENEVE | 1u << GTP,
+  1u << DOT1Q | 1u << MPLS | 1u << IP | 1u << IPV6,
+  1u << ETHERNET,
+  1u << ETHERNET | 1u << DOT1Q | 1u << MPLS | 1u << IP | 1u << IPV6,
+  1u << IP | 1u << IPV6,
+};
+
+/* Whether parsing continues below layer, everything is parsed by default */
+static std::array<bool, LAYER_COUNT> descend_layers = {
+  true, true, true, true, true, true, true, true, true, true, true,
+};
+
+static LayerIndex
+layer_index(Tins::PDU::PDUType type)
+{
+  switch (static_cast<std::uint32_t>(type)) {
+    case Tins::PDU::PDUType::ETHERNET_II:
+      return ETHERNET;
+    case Tins::PDU::PDUType::DOT1Q:
+      return DOT1Q;
+    case Tins::PDU::PDUType::MPLS:
+      return MPLS;
+    case Tins::PDU::PDUType::IP:
+      return IP;
+    case Tins::PDU::PDUType::IPv6:
+      return IPV6;
+    case Tins::PDU::PDUType::TCP:
+      return TCP;
+    case Tins::PDU::PDUType::UDP:
+      return UDP;
+    case Protocols::GREPDU_TYPE:
+      return GRE;
+    case Protocols::VXLANPDU_TYPE:
+      return VXLAN;
+    case Protocols::GENEVEPDU_TYPE:
+      return GENEVE;
+    case Protocols::GTPPDU_TYPE:
+      return GTP;
+    default:
+      return LAYER_COUNT;
+  }
+}
+
+void
+require_layers(const std::function<bool(Tins::PDU::PDUType)>& needed)
+{
+  auto required = std::array<bool, LAYER_COUNT>{};
+  for (auto i = 0u; i < LAYER_COUNT; ++i)
+    required[i] = needed(layer_types[i]);
+
+  /* Tunnels are entered only when they are needed themselves */
+  auto usable = std::uint32_t{0};
+  for (auto i = 0u; i < LAYER_COUNT; ++i) {
+    if (required[i] || (i != GRE && i != VXLAN && i != GENEVE && i != GTP))
+      usable |= 1u << i;
+  }
+
+  /* Layer is worth descending if a needed layer can be reached from it.
+   * Tunnels make the graph cyclic, so iterate until nothing changes */
+  descend_layers.fill(false);
+  for (auto changed = true; changed;) {
+    changed = false;
+    for (auto i = 0u; i < LAYER_COUNT; ++i) {
+      auto descend = false;
+      for (auto j = 0u; j < LAYER_COUNT; ++j) {
+        if (inner_layers[i] & usable & (1u << j))
+          descend = descend || required[j] || descend_layers[j];
+      }
+
+      if (descend != descend_layers[i]) {
+        descend_layers[i] = descend;
+        changed = true;
+      }
+    }
+  }
+
+  /* Tunnel which is not needed is parsed only up to its own header */
+  for (auto i = 0u; i < LAYER_COUNT; ++i) {
+    if (!(usable & (1u << i)))
+      descend_layers[i] = false;
+  }
+}
+
+bool
+descends(Tins::PDU::PDUType type)
+{
+  auto index = layer_index(type);
+  return index == LAYER_COUNT || descend_layers[index];
+}
+
+bool
+parses_udp_payload(std::uint16_t port)
+{
+  return descends(Tins::PDU::PDUType::UDP) && udp_parsers.count(port) != 0;
 }
 
 static Tins::PDU*
@@ -20,7 +154,7 @@ parse_udp(const Tins::UDP* udp) {
     return nullptr;
 
   auto raw = udp->find_pdu<Tins::RawPDU>();
-  return search->second(raw->payload().data(), raw->payload_size());
+  return search->second.parse(raw->payload().data(), raw->payload_size());
 }
 
 
@@ -35,6 +169,8 @@ parse(const std::uint8_t* data, std::uint32_t size)
     Tins::PDU* inner;
     switch (p->pdu_type()) {
       case Tins::PDU::PDUType::UDP:
+        if (!descends(Tins::PDU::PDUType::UDP))
+          break;
         inner = parse_udp(dynamic_cast<Tins::UDP*>(p));
         if (inner)
           p->inner_pdu(inner);
@@ -50,4 +186,237 @@ parse(const std::uint8_t* data, std::uint32_t size)
   return std::unique_ptr<Tins::PDU>{pdu};
 }
 
+static std::uint16_t
+read16(const std::uint8_t* data)
+{
+  return (std::uint16_t{data[0]} << 8) | data[1];
+}
+
+/**
+ * Maps EtherType to type of header it announces. Headers not known to fast
+ * path are left as payload, same as libtins leaves them without reducer.
+ */
+static Tins::PDU::PDUType
+ethertype_layer(std::uint16_t ethertype)
+{
+  switch (ethertype) {
+    case Tins::Constants::Ethernet::IP:
+      return Tins::PDU::PDUType::IP;
+    case Tins::Constants::Ethernet::IPV6:
+      return Tins::PDU::PDUType::IPv6;
+    case Tins::Constants::Ethernet::VLAN:
+    case Tins::Constants::Ethernet::QINQ:
+      return Tins::PDU::PDUType::DOT1Q;
+    case Tins::Constants::Ethernet::MPLS:
+      return Tins::PDU::PDUType::MPLS;
+    default:
+      return Tins::PDU::PDUType::RAW;
+  }
+}
+
+static Tins::PDU::PDUType
+protocol_layer(std::uint8_t protocol)
+{
+  switch (protocol) {
+    case IPPROTO_TCP:
+      return Tins::PDU::PDUType::TCP;
+    case IPPROTO_UDP:
+      return Tins::PDU::PDUType::UDP;
+    case IPPROTO_GRE:
+      return Protocols::GREPDU_TYPE;
+    case IPPROTO_IPIP:
+      return Tins::PDU::PDUType::IP;
+    case IPPROTO_IPV6:
+      return Tins::PDU::PDUType::IPv6;
+    default:
+      return Tins::PDU::PDUType::RAW;
+  }
+}
+
+static bool
+ipv6_extension(std::uint8_t next_header)
+{
+  switch (next_header) {
+    case IPPROTO_HOPOPTS:
+    case IPPROTO_ROUTING:
+    case IPPROTO_FRAGMENT:
+    case IPPROTO_DSTOPTS:
+    case IPPROTO_AH:
+    case IPPROTO_MH:
+      return true;
+    default:
+      return false;
+  }
+}
+
+const char*
+error_name(Error error)
+{
+  switch (error) {
+    case Error::NONE:
+      return "none";
+    case Error::UNKNOWN_ETHERTYPE:
+      return "unknown ethertype";
+    case Error::UNSUPPORTED:
+      return "unsupported headers";
+    case Error::TRUNCATED:
+      return "truncated headers";
+    case Error::BAD_VERSION:
+      return "bad IP version";
+    case Error::BAD_IHL:
+      return "bad IHL";
+    case Error::BAD_TCP_OFFSET:
+      return "bad TCP data offset";
+    case Error::BAD_TUNNEL:
+      return "bad tunnel header";
+    case Error::MALFORMED:
+      return "malformed headers";
+    default:
+      return "unknown";
+  }
+}
+
+Error
+parse(const std::uint8_t* data, std::uint32_t size, Layers& layers) noexcept
+{
+  auto type = Tins::PDU::PDUType::ETHERNET_II;
+  std::uint32_t offset = 0;
+  auto unknown = false;
+  layers.count = 0;
+
+  /* Every header tells type of the next one, payload ends the walk */
+  while (type != Tins::PDU::PDUType::RAW) {
+    const auto* header = data + offset;
+    const auto available = size - offset;
+    std::uint32_t length;
+    auto next = Tins::PDU::PDUType::RAW;
+    auto ethertype = false;
+
+    switch (static_cast<std::uint32_t>(type)) {
+      case Tins::PDU::PDUType::ETHERNET_II:
+        length = 14;
+        if (available < length)
+          return Error::TRUNCATED;
+        next = ethertype_layer(read16(header + 12));
+        ethertype = true;
+        break;
+      case Tins::PDU::PDUType::DOT1Q:
+        length = 4;
+        if (available < length)
+          return Error::TRUNCATED;
+        next = ethertype_layer(read16(header + 2));
+        ethertype = true;
+        break;
+      case Tins::PDU::PDUType::MPLS:
+        length = 4;
+        if (available < length)
+          return Error::TRUNCATED;
+        /* Below the bottom of stack is IP packet of version in first nibble */
+        if (!(header[2] & 0x01))
+          next = Tins::PDU::PDUType::MPLS;
+        else if (available > length && header[4] >> 4 == 4)
+          next = Tins::PDU::PDUType::IP;
+        else if (available > length && header[4] >> 4 == 6)
+          next = Tins::PDU::PDUType::IPv6;
+        break;
+      case Tins::PDU::PDUType::IP: {
+        auto error = ipv4_header(header, available, length);
+        if (error != Error::NONE)
+          return error;
+        /* Fragments carry no transport header of their own */
+        if (!(read16(header + 6) & 0x3fff))
+          next = protocol_layer(header[9]);
+        break;
+      }
+      case Tins::PDU::PDUType::IPv6:
+        length = 40;
+        if (available < length)
+          return Error::TRUNCATED;
+        if (header[0] >> 4 != 6)
+          return Error::BAD_VERSION;
+        if (ipv6_extension(header[6]))
+          return Error::UNSUPPORTED;
+        next = protocol_layer(header[6]);
+        break;
+      case Tins::PDU::PDUType::TCP: {
+        auto error = tcp_header(header, available, length);
+        if (error != Error::NONE)
+          return error;
+        break;
+      }
+      case Tins::PDU::PDUType::UDP:
+        length = 8;
+        if (available < length)
+          return Error::TRUNCATED;
+        /* Payload parsed by a parser unknown to fast path is left to it */
+        if (descends(type)) {
+          auto search = udp_parsers.find(read16(header + 2));
+          if (search != udp_parsers.end()) {
+            if (layer_index(search->second.type) == LAYER_COUNT)
+              return Error::UNSUPPORTED;
+            next = search->second.type;
+          }
+        }
+        break;
+      case Protocols::GREPDU_TYPE:
+        length = Protocols::GREHeader::header_size(header, available);
+        if (length == 0)
+          return Error::BAD_TUNNEL;
+        next = ethertype_layer(Protocols::GREHeader{header}.protocol());
+        ethertype = true;
+        break;
+      case Protocols::VXLANPDU_TYPE:
+        length = Protocols::VXLANHeader::header_size(header, available);
+        if (length == 0)
+          return Error::BAD_TUNNEL;
+        next = Tins::PDU::PDUType::ETHERNET_II;
+        break;
+      case Protocols::GENEVEPDU_TYPE: {
+        length = Protocols::GENEVEHeader::header_size(header, available);
+        if (length == 0)
+          return Error::BAD_TUNNEL;
+        auto protocol = Protocols::GENEVEHeader{header}.protocol();
+        next = protocol == Protocols::GENEVEHeader::PROTOCOL_TEB
+          ? Tins::PDU::PDUType::ETHERNET_II
+          : ethertype_layer(protocol);
+        ethertype = true;
+        break;
+      }
+      case Protocols::GTPPDU_TYPE:
+        length = Protocols::GTPHeader::header_size(header, available);
+        if (length == 0)
+          return Error::BAD_TUNNEL;
+        /* User data are IP packets of version in the first nibble */
+        if (Protocols::GTPHeader{header}.message_type()
+            != Protocols::GTPHeader::MESSAGE_G_PDU || available == length)
+          break;
+        if (header[length] >> 4 == 4)
+          next = Tins::PDU::PDUType::IP;
+        else if (header[length] >> 4 == 6)
+          next = Tins::PDU::PDUType::IPv6;
+        break;
+      default:
+        return Error::UNSUPPORTED;
+    }
+
+    /* Nothing below this layer contributes to flow key */
+    if (!descends(type))
+      next = Tins::PDU::PDUType::RAW;
+    else if (ethertype && next == Tins::PDU::PDUType::RAW)
+      unknown = true;
+
+    if (layers.count == Layers::MAX_LAYERS
+        || offset + length > Layers::MAX_HEADERS)
+      return Error::UNSUPPORTED;
+
+    layers.layers[layers.count++] = Layer{type,
+      static_cast<std::uint16_t>(offset), static_cast<std::uint16_t>(length)};
+    offset += length;
+    type = next;
+  }
+
+  std::memcpy(layers.headers.data(), data, offset);
+  return unknown ? Error::UNKNOWN_ETHERTYPE : Error::NONE;
+}
+
 } // namespace Parser
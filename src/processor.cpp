@@ -1,11 +1,21 @@
 #include <processor.hpp>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <csignal>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include <tins/tins.h>
 
+#include <batch.hpp>
 #include <options.hpp>
 #include <parser.hpp>
 #include <reducer.hpp>
@@ -18,6 +28,8 @@
 /* Parsers */
 #include <protocols/gre.hpp>
 #include <protocols/vxlan.hpp>
+#include <protocols/geneve.hpp>
+#include <protocols/gtp.hpp>
 
 /* Reducers */
 #include <flows/ip.hpp>
@@ -27,13 +39,35 @@
 #include <flows/vlan.hpp>
 #include <flows/vxlan.hpp>
 #include <flows/gre.hpp>
+#include <flows/geneve.hpp>
 #include <flows/mpls.hpp>
 #include <flows/ethernet.hpp>
 
 namespace Flow {
 
+/* Maximal number of packets requested from input at once */
+static constexpr unsigned int CAPTURE_BATCH = 64;
+
+/* Seconds between reports of packets dropped by parser */
+static constexpr long ERROR_REPORT_INTERVAL = 60;
+
 static std::atomic<bool> running = true;
 
+/**
+ * Parsed packet, into layers or into PDU when fast path does not
+ * understand it. Packets are parsed by capture thread and passed to
+ * processing thread, unless they are leased from input plugin. Leased
+ * packets are passed alone and parsed by processing thread into its own
+ * frames without copying. Packet metadata are always valid, its data only
+ * while leased. Packets extracted in batch carry digest of their 5-tuple.
+ */
+struct Frame {
+  std::unique_ptr<Tins::PDU> pdu;
+  LeasedPacket lease;
+  Parser::Layers layers;
+  std::uint32_t digest;
+};
+
 static void
 on_signal(int)
 {
@@ -46,30 +80,166 @@ on_signal(int)
   running = false;
 }
 
-static Buffer
-sub_template_multi_list()
+/* Flow hash of 5-tuple, provided by input or computed as digest, can be used
+ * instead of hashing flow key */
+static bool input_hash = false;
+
+static bool
+transport_layer(Tins::PDU::PDUType type)
 {
-  auto result = Buffer{};
+  return type == Tins::PDU::PDUType::TCP || type == Tins::PDU::PDUType::UDP;
+}
 
-  result.push_back_any<std::uint8_t>(0);
-  result.push_back_any<std::uint8_t>(IPFIX::SEMANTIC_ORDERED);
+/**
+ * Measures headers of packet up to the end of its innermost transport
+ * layer. Headers are measured on captured data.
+ * @return Length of headers or zero if packet has no transport layer.
+ */
+static std::size_t
+transport_headers(const Tins::PDU* pdu, const Packet& packet)
+{
+  const Tins::PDU* transport = nullptr;
+  for (auto* p = pdu; p != nullptr; p = p->inner_pdu()) {
+    if (transport_layer(p->pdu_type()))
+      transport = p;
+  }
+
+  if (transport == nullptr)
+    return 0;
 
-  return result;
+  auto* payload = transport->inner_pdu();
+  return packet.caplen - (payload ? payload->size() : 0);
 }
 
-/* Processor */
-Processor::Processor()
-  : _exporter(Options::options().ip_address, Options::options().port),
-  _active_timeout(Options::options().active_timeout),
-  _idle_timeout(Options::options().idle_timeout)
+/**
+ * Digest of 5-tuple of packet, whose layers in flow key are exactly one
+ * network layer, IPv4, and one transport layer. Then the key holds the
+ * whole 5-tuple, so packets of the same flow have the same digest
+ * whichever way they were parsed.
+ * @return Digest or zero if packet has other layers in its key.
+ */
+static std::uint32_t
+layers_digest(const Parser::Layers& layers)
+{
+  const Parser::Layer* network = nullptr;
+  const Parser::Layer* transport = nullptr;
+
+  for (auto i = 0u; i < layers.count; ++i) {
+    const auto& layer = layers.layers[i];
+    if (layer.type == Tins::PDU::PDUType::IP
+        || layer.type == Tins::PDU::PDUType::IPv6) {
+      if (network != nullptr || layer.type != Tins::PDU::PDUType::IP)
+        return 0;
+      network = &layer;
+    } else if (transport_layer(layer.type)) {
+      if (transport != nullptr)
+        return 0;
+      transport = &layer;
+    }
+  }
+
+  if (network == nullptr || transport == nullptr)
+    return 0;
+
+  const auto* ip = layers.header(*network);
+  const auto* ports = layers.header(*transport);
+  std::uint32_t src, dst;
+  std::memcpy(&src, ip + 12, sizeof(src));
+  std::memcpy(&dst, ip + 16, sizeof(dst));
+
+  return Parser::digest(src, dst, ip[9], ports[0] << 8 | ports[1],
+      ports[2] << 8 | ports[3]);
+}
+
+static std::uint32_t
+pdu_digest(const Tins::PDU* pdu)
+{
+  const Tins::IP* network = nullptr;
+  const Tins::PDU* transport = nullptr;
+
+  for (auto* p = pdu; p != nullptr; p = p->inner_pdu()) {
+    if (p->pdu_type() == Tins::PDU::PDUType::IP
+        || p->pdu_type() == Tins::PDU::PDUType::IPv6) {
+      if (network != nullptr || p->pdu_type() != Tins::PDU::PDUType::IP)
+        return 0;
+      network = static_cast<const Tins::IP*>(p);
+    } else if (transport_layer(p->pdu_type())) {
+      if (transport != nullptr)
+        return 0;
+      transport = p;
+    }
+
+    if (!Parser::descends(p->pdu_type()))
+      break;
+  }
+
+  if (network == nullptr || transport == nullptr)
+    return 0;
+
+  auto tcp = transport->pdu_type() == Tins::PDU::PDUType::TCP;
+  const auto* tcp_pdu = static_cast<const Tins::TCP*>(transport);
+  const auto* udp_pdu = static_cast<const Tins::UDP*>(transport);
+
+  return Parser::digest(network->src_addr(), network->dst_addr(),
+      network->protocol(), tcp ? tcp_pdu->sport() : udp_pdu->sport(),
+      tcp ? tcp_pdu->dport() : udp_pdu->dport());
+}
+
+/**
+ * Counts packets and bytes of frame as they were on wire. Frame coalesced
+ * by GRO or LRO holds payload of several segments, every one of them
+ * carried its own copy of headers up to the innermost transport layer.
+ * @return Number of packets and their total length.
+ */
+static std::pair<std::size_t, std::size_t>
+wire_counts(const Packet& packet, std::size_t headers)
+{
+  if (packet.segment_size == 0 || headers == 0 || headers >= packet.len)
+    return {1, packet.len};
+
+  std::size_t data = packet.len - headers;
+  std::size_t segments = (data + packet.segment_size - 1) / packet.segment_size;
+  if (segments <= 1)
+    return {1, packet.len};
+
+  return {segments, packet.len + (segments - 1) * headers};
+}
+
+/**
+ * Checks whether section of configuration keys flows by both
+ * source and destination.
+ */
+static bool
+keys_both(const toml::value& config, const char* section)
+{
+  if (!config.contains(section))
+    return false;
+
+  const auto& table = toml::find(config, section);
+  return toml::find_or(table, "src", false)
+    && toml::find_or(table, "dst", false);
+}
+
+/**
+ * Registers parsers and reducers shared by all processors.
+ */
+static void
+register_protocols()
 {
   const auto& config = Options::config();
 
-  /* Register additional parsers */
+  /* Register additional parsers, GRE after both IP versions as in fast
+   * path */
   Parser::register_tins_parser<Tins::IP, Protocols::GREPDU>(
       IPFIX::PROTOCOL_GRE);
+  Parser::register_tins_parser<Tins::IPv6, Protocols::GREPDU>(
+      IPFIX::PROTOCOL_GRE);
   Parser::register_udp_parser<Protocols::VXLANPDU>(
       Protocols::VXLANPDU::VXLAN_PORT);
+  Parser::register_udp_parser<Protocols::GENEVEPDU>(
+      Protocols::GENEVEPDU::GENEVE_PORT);
+  Parser::register_udp_parser<Protocols::GTPPDU>(
+      Protocols::GTPPDU::GTP_PORT);
 
   /* Register reducers */
   Reducer::register_reducer<IP>(Tins::PDU::PDUType::IP, config);
@@ -81,65 +251,153 @@ Processor::Processor()
   Reducer::register_reducer<ETHERNET>(Tins::PDU::PDUType::ETHERNET_II, config);
   Reducer::register_reducer<GRE>(Protocols::GREPDU_TYPE, config);
   Reducer::register_reducer<VXLAN>(Protocols::VXLANPDU_TYPE, config);
+  Reducer::register_reducer<GENEVE>(Protocols::GENEVEPDU_TYPE, config);
+
+  /* Parse only as deep as some reducer can contribute to flow key. GTP-U
+   * has no fields of its own, its section only enables decapsulation */
+  auto gtp = config.contains("gtp");
+  Parser::require_layers([gtp](Tins::PDU::PDUType type) {
+    if (type == Protocols::GTPPDU_TYPE)
+      return gtp;
+
+    const auto* reducer = Reducer::reducer(type);
+    return reducer != nullptr && reducer->should_process();
+  });
+
+  /* 5-tuple hash depends only on flow key if all of its fields are keyed,
+   * only then packets with the same key are placed in the same bucket */
+  input_hash = keys_both(config, "ip") && keys_both(config, "ipv6")
+    && keys_both(config, "tcp") && keys_both(config, "udp");
 
   std::signal(SIGINT, on_signal);
 }
 
-void
-Processor::process(Tins::PDU* pdu, timeval timestamp)
+/* Processor */
+Processor::Processor()
+  : _exporter(Options::options().ip_address, Options::options().port),
+  _active_timeout(Options::options().active_timeout),
+  _idle_timeout(Options::options().idle_timeout)
 {
-  auto flow_digest = std::size_t{0};
-
-  /* Generate digest */
-  for (auto* p = pdu; p != nullptr; p = p->inner_pdu()) {
-    const auto* reducer = Reducer::reducer(p->pdu_type());
-    if (reducer == nullptr)
-      continue;
+  static std::once_flag registered;
+  std::call_once(registered, register_protocols);
+}
 
-    if (!reducer->should_process())
-      continue;
+std::uint16_t
+Processor::template_id(const Flow& reducer)
+{
+  auto type = reducer.type();
+  if (type < _template_ids.size() && _template_ids[type] != 0)
+    return _template_ids[type];
 
-    flow_digest = combine(flow_digest, reducer->digest(*p));
+  auto tid = _exporter.get_template_id(type);
+  if (tid == 0) {
+    tid = _exporter.insert_template(type, reducer.fields());
   }
 
-  /* If the digest is already in cache */
-  auto search = _cache.find(flow_digest);
-  if (search != _cache.end()) {
-    _cache.update_record(search, timestamp);
-    check_active_timeout(timestamp.tv_sec, search->second);
+  if (type < _template_ids.size())
+    _template_ids[type] = tid;
+
+  return tid;
+}
+
+template<typename T>
+void
+Processor::append_values(Tins::PDU::PDUType type, const T& layer)
+{
+  const auto* reducer = Reducer::reducer(type);
+  if (reducer == nullptr)
+    return;
+
+  if (!reducer->should_process())
     return;
-  }
 
-  auto flow_values = sub_template_multi_list();
+  auto offset = _key.size();
+  _key.push_back_any<std::uint16_t>(htons(template_id(*reducer)));
+  _key.push_back_any<std::uint16_t>(0);
+  reducer->values(layer, _key);
+  _key.set_any_at<std::uint16_t>(offset + 2, htons(_key.size() - offset));
+}
 
-  /* Generate values */
+void
+Processor::process(Tins::PDU* pdu, const Packet& packet)
+{
+  /* Generate values, they are both exported and used as flow key */
+  _key.clear();
+  _key.push_back_any<std::uint8_t>(0);
+  _key.push_back_any<std::uint8_t>(IPFIX::SEMANTIC_ORDERED);
+
+  /* Stop where fast path would stop, so both give the same keys */
   for (auto* p = pdu; p != nullptr; p = p->inner_pdu()) {
-    const auto* reducer = Reducer::reducer(p->pdu_type());
-    if (reducer == nullptr)
-      continue;
+    append_values(p->pdu_type(), *p);
 
-    if (!reducer->should_process())
-      continue;
+    if (!Parser::descends(p->pdu_type()))
+      break;
+  }
 
-    auto type = reducer->type();
-    auto tid = _exporter.get_template_id(type);
-    if (tid == 0) {
-      tid = _exporter.insert_template(type, reducer->fields());
-    }
+  account(packet, packet.segment_size ? transport_headers(pdu, packet) : 0,
+      input_hash ? pdu_digest(pdu) : 0);
+}
+
+void
+Processor::process(const Parser::Layers& layers, const Packet& packet,
+    std::uint32_t digest)
+{
+  std::size_t headers = 0;
+
+  _key.clear();
+  _key.push_back_any<std::uint8_t>(0);
+  _key.push_back_any<std::uint8_t>(IPFIX::SEMANTIC_ORDERED);
+
+  for (auto i = 0u; i < layers.count; ++i) {
+    const auto& layer = layers.layers[i];
+    append_values(layer.type, layers.header(layer));
 
-    auto values = reducer->values(*p);
-    flow_values.push_back_any<std::uint16_t>(htons(tid));
-    flow_values.push_back_any<std::uint16_t>(htons(values.size() + 4));
-    flow_values.insert(flow_values.end(), values.begin(), values.end());
+    if (transport_layer(layer.type))
+      headers = layer.offset + layer.size;
   }
 
+  if (input_hash && digest == 0)
+    digest = layers_digest(layers);
+
+  account(packet, headers, digest);
+}
+
+void
+Processor::account(const Packet& packet, std::size_t headers,
+    std::uint32_t digest)
+{
+  auto timestamp = timeval{packet.sec, packet.usec};
+
   /* Check if record isn't empty */
-  if (flow_values.size() <= 2)
+  if (_key.size() <= 2)
     return;
 
-  flow_values.set_any_at<std::uint8_t>(0, flow_values.size() - 1);
+  _key.set_any_at<std::uint8_t>(0, _key.size() - 1);
+
+  /* Hash provided by input or digest of 5-tuple saves hashing the key,
+   * the key is still compared to tell apart flows with the same hash.
+   * Input hash is trusted only if input declares it as 5-tuple hash */
+  std::size_t hash;
+  if (input_hash && _tuple_hash && packet.hash != 0)
+    hash = packet.hash;
+  else if (input_hash && digest != 0)
+    hash = digest;
+  else
+    hash = std::hash<std::string_view>{}(std::string_view{
+        reinterpret_cast<const char*>(_key.data()), _key.size()});
+
+  auto [packets, octets] = wire_counts(packet, headers);
+
+  /* If the flow is already in cache */
+  auto search = _cache.find_record(hash, packet.interface, _key);
+  if (search != _cache.end()) {
+    _cache.update_record(search, timestamp, packets, octets);
+    check_active_timeout(timestamp.tv_sec, search->second);
+    return;
+  }
 
-  _cache.insert_record(flow_digest, timestamp, std::move(flow_values));
+  _cache.insert_record(hash, timestamp, packet.interface, packets, octets,
+      _key);
 }
 
 void
@@ -154,7 +412,7 @@ Processor::check_active_timeout(std::uint32_t now, CacheEntry& entry)
 
   // TODO(dudoslav): Should we reset counter to 0 or 1?
   _exporter.insert_record(entry.props, IPFIX::REASON_ACTIVE, entry.values);
-  entry.props = {0, {now, 0}, {now, 0}};
+  entry.props = {0, 0, {now, 0}, {now, 0}, entry.props.interface};
 }
 
 void
@@ -185,67 +443,337 @@ Processor::check_idle_timeout(std::uint32_t now, std::size_t peek_size)
   }
 }
 
+/* Packets leased from input, passed to processing thread unparsed */
+using Leases = Async::Queue<LeasedPacket>;
+
+/* PDUs parsed by capture thread are given back to it to be freed */
+using Garbage = Async::Queue<std::unique_ptr<Tins::PDU>>;
+
+/* Packets counted by parser result, written by the thread that parses */
+using ParseErrors = std::array<std::atomic<std::size_t>,
+      static_cast<std::size_t>(Parser::Error::ERROR_COUNT)>;
+
+/* Snapshot of parse error counters */
+using ErrorCounts = std::array<std::size_t,
+      static_cast<std::size_t>(Parser::Error::ERROR_COUNT)>;
+
+/**
+ * Parses packet of frame into layers, or into PDU if fast path does not
+ * understand it. Nothing is thrown, malformed packets are only counted.
+ * @return False if packet is malformed and has to be dropped.
+ */
+static bool
+parse_frame(Frame& frame, const Packet& packet, ParseErrors& errors)
+{
+  auto count = [&errors](Parser::Error error) {
+    auto& counter = errors[static_cast<std::size_t>(error)];
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+  };
+
+  auto error = Parser::parse(packet.data, packet.caplen, frame.layers);
+
+  /* Packet rejected by libtins too is counted only as malformed */
+  if (error == Parser::Error::UNSUPPORTED) {
+    try {
+      frame.pdu = Parser::parse(packet.data, packet.caplen);
+    } catch (const std::exception&) {
+      frame.pdu = nullptr;
+    }
+
+    count(frame.pdu != nullptr
+        ? Parser::Error::UNSUPPORTED : Parser::Error::MALFORMED);
+    return frame.pdu != nullptr;
+  }
+
+  if (error != Parser::Error::NONE)
+    count(error);
+
+  return Parser::parsed(error);
+}
+
+/**
+ * Logs packets dropped by parser since the last report by reason, nothing
+ * if none was dropped.
+ * @param reported counts of the last report, updated to current ones.
+ */
+static void
+report_errors(unsigned int id, const ParseErrors& errors,
+    ErrorCounts& reported,
+    long seconds)
+{
+  auto reasons = std::string{};
+  auto dropped = std::size_t{0};
+
+  for (auto i = static_cast<std::size_t>(Parser::Error::TRUNCATED);
+      i < errors.size(); ++i) {
+    auto count = errors[i].load(std::memory_order_relaxed);
+    if (count == reported[i])
+      continue;
+
+    reasons += reasons.empty() ? " (" : ", ";
+    reasons += std::to_string(count - reported[i]) + " "
+      + Parser::error_name(static_cast<Parser::Error>(i));
+    dropped += count - reported[i];
+    reported[i] = count;
+  }
+
+  if (dropped != 0) {
+    Log::info("Queue %u: %zu malformed packets dropped in %ld s%s)\n", id,
+        dropped, seconds, reasons.c_str());
+  }
+}
+
+/**
+ * Parses batch of frames. Key fields of packets of the common shape are
+ * extracted together into columns, which give their layers and digest,
+ * other packets are parsed one by one. Malformed frames are left with
+ * neither layers nor PDU.
+ */
+static void
+parse_frames(Frame* frames, std::size_t count, ParseErrors& errors)
+{
+  constexpr auto width = Parser::Columns::WIDTH;
+  auto packets = std::array<Packet, width>{};
+  auto columns = Parser::Columns{};
+
+  for (std::size_t first = 0; first < count; first += width) {
+    auto batch = std::min(width, count - first);
+    for (std::size_t i = 0; i < batch; ++i)
+      packets[i] = frames[first + i].lease.packet;
+
+    Parser::extract(packets.data(), batch, columns);
+
+    for (std::size_t i = 0; i < batch; ++i) {
+      auto& frame = frames[first + i];
+      frame.digest = 0;
+
+      if (columns.simple[i]) {
+        Parser::fill(columns, i, packets[i].data, frame.layers);
+        frame.digest = columns.digest[i];
+      } else if (!parse_frame(frame, packets[i], errors)) {
+        frame.layers.count = 0;
+      }
+    }
+  }
+}
+
 static void
-capture_worker(Async::Queue<Tins::Packet>& queue)
+capture_worker(Plugins::Input& input, unsigned int id,
+    Async::Queue<Frame>& queue, Leases& leased, Garbage& garbage,
+    ParseErrors& errors, std::atomic<bool>& capturing)
 {
-  auto input = Plugins::create_input(Options::options().input_plugin,
-      Options::options().argument.c_str());
+  const auto leasing = input.leases();
+  auto packets = std::array<Packet, CAPTURE_BATCH>{};
+  auto leases = std::array<LeasedPacket, CAPTURE_BATCH>{};
+  auto frames = std::array<Frame, CAPTURE_BATCH>{};
 
   while (running) {
-    auto result = input.get_packet();
+    /* Free processed PDUs on the thread that allocated them */
+    while (!garbage.empty())
+      garbage.pop();
 
-    if (result.type != CAPTURE_PACKET) {
-      running = false;
+    auto result = leasing
+      ? input.lease_packets(id, leases.data(), leases.size())
+      : input.get_packets(id, packets.data(), packets.size());
+
+    /* Buffer timeout, keep polling while running */
+    if (result.type == CAPTURE_TIMEOUT)
+      continue;
+
+    if (result.type == CAPTURE_INPUT_ERROR)
+      Log::error("Capture failed: %s\n", input.last_error());
+
+    if (result.type != CAPTURE_PACKET)
       break;
+
+    /* Leased packets are parsed by processing thread */
+    if (leasing) {
+      for (unsigned int i = 0; i < result.count; ++i)
+        leased.push(LeasedPacket{leases[i]});
+      continue;
     }
 
-    auto pdu = Parser::parse(result.packet.data, result.packet.caplen);
-    auto timestamp = timeval{result.packet.sec, result.packet.usec};
+    for (unsigned int i = 0; i < result.count; ++i)
+      frames[i].lease = {packets[i], nullptr};
 
-    if (pdu == nullptr)
-      continue;
+    parse_frames(frames.data(), result.count, errors);
 
-    queue.push(Tins::Packet{pdu.release(), timestamp, {}});
+    for (unsigned int i = 0; i < result.count; ++i) {
+      if (frames[i].pdu != nullptr || frames[i].layers.count != 0)
+        queue.push(std::move(frames[i]));
+    }
   }
+
+  /* Other queues of input may still be running */
+  capturing = false;
 }
 
-static timeval
-timestamp_to_timeval(const Tins::Timestamp& timestamp)
+void
+Processor::start()
 {
-  return {
-    timestamp.seconds(), timestamp.microseconds()
-  };
+  const auto& options = Options::options();
+  auto input = Plugins::create_input(options.input_plugin,
+      options.argument.c_str(),
+      CaptureOptions{options.filter.c_str(), options.snaplen});
+  auto queues = input.queue_count();
+
+  if (queues > 1)
+    Log::info("Processing %u input queues\n", queues);
+
+  /* Every other queue has its own processor with own cache and exporter */
+  auto processors = std::vector<std::unique_ptr<Processor>>{};
+  for (auto id = 1u; id < queues; ++id)
+    processors.push_back(std::make_unique<Processor>());
+
+  /* Interface is exported only if input tells packets of interfaces apart */
+  _exporter.set_interfaces(input.interfaces());
+  for (auto& processor : processors)
+    processor->_exporter.set_interfaces(input.interfaces());
+
+  _tuple_hash = input.tuple_hash();
+  for (auto& processor : processors)
+    processor->_tuple_hash = input.tuple_hash();
+
+  running = true;
+
+  auto threads = std::vector<std::thread>{};
+  for (auto id = 1u; id < queues; ++id) {
+    threads.emplace_back(&Processor::run, processors[id - 1].get(),
+        std::ref(input), id);
+  }
+
+  run(input, 0);
+
+  for (auto& thread : threads)
+    thread.join();
+
+  if (auto stats = input.statistics()) {
+    Log::info("Input packets: %llu, dropped: %llu\n",
+        stats->packets, stats->drops);
+  }
 }
 
 void
-Processor::start()
+Processor::run(Plugins::Input& input, unsigned int id)
 {
   using namespace std::chrono;
-  
+
   _time_point = high_resolution_clock::now();
-  auto queue = Async::Queue<Tins::Packet>{};
+  const auto leasing = input.leases();
+  auto frames = std::array<Frame, Parser::Columns::WIDTH>{};
+  auto queue = Async::Queue<Frame>{};
+  auto leased = Leases{};
+  auto garbage = Garbage{};
+  auto errors = ParseErrors{};
+  auto capturing = std::atomic<bool>{true};
+  auto releases = std::vector<void*>{};
+
+  /* PDUs handed back to capture thread to be freed by the thread that
+   * allocated them, they are reported each second */
+  auto handed_back = std::size_t{0};
+  auto reported = std::size_t{0};
+  auto report_sec = duration_cast<seconds>(
+      _time_point.time_since_epoch()).count();
+
+  /* Packets dropped by parser, the other results are only informative.
+   * Their rate is logged each second with debug, their reasons in longer
+   * intervals */
+  auto reported_malformed = std::size_t{0};
+  auto reported_errors = ErrorCounts{};
+  auto errors_sec = report_sec;
+  auto malformed = [&]() {
+    auto count = std::size_t{0};
+    for (auto i = static_cast<std::size_t>(Parser::Error::TRUNCATED);
+        i < errors.size(); ++i)
+      count += errors[i].load(std::memory_order_relaxed);
+    return count;
+  };
 
-  running = true;
+  /* Only one of the queues is used, depending on input */
+  auto queued = [&]() {
+    return !queue.empty() || !leased.empty();
+  };
+
+  /* Give leased packets back to input */
+  auto release = [&]() {
+    if (releases.empty())
+      return;
+
+    input.release_packets(releases.data(), releases.size());
+    releases.clear();
+  };
 
   /* Start packet capture and parsing thread */
-  auto capture_thread = std::thread(capture_worker, std::ref(queue));
+  auto capture_thread = std::thread(capture_worker, std::ref(input), id,
+      std::ref(queue), std::ref(leased), std::ref(garbage), std::ref(errors),
+      std::ref(capturing));
 
   /* Start packet reducing loop */
   try {
-    while (running || !queue.empty()) {
+    while (capturing || queued()) {
       /* Calculate time delta */
       auto now = high_resolution_clock::now();
       auto delta = duration<double, std::milli>(now - _time_point).count();
       _time_point = now;
 
-      auto now_sec = duration_cast<seconds>(now.time_since_epoch()).count();
-      if (!queue.empty()) {
-        /* Get packet from parsed packets queue */
-        auto packet = queue.pop();
-	now_sec = packet.timestamp().seconds();
-        process(packet.pdu(), timestamp_to_timeval(packet.timestamp()));
+      auto wall_sec = duration_cast<seconds>(now.time_since_epoch()).count();
+      auto now_sec = wall_sec;
+      if (queued()) {
+        /* Get batch of packets, leased ones are parsed here */
+        auto count = std::size_t{0};
+        if (leasing) {
+          while (count < frames.size() && !leased.empty()) {
+            auto& frame = frames[count++];
+            frame.lease = leased.pop();
+            releases.push_back(frame.lease.handle);
+          }
+          parse_frames(frames.data(), count, errors);
+        } else {
+          while (count < frames.size() && !queue.empty())
+            frames[count++] = queue.pop();
+        }
+
+        for (std::size_t i = 0; i < count; ++i) {
+          auto& frame = frames[i];
+          const auto& packet = frame.lease.packet;
+
+          if (frame.pdu != nullptr) {
+            now_sec = packet.sec;
+            process(frame.pdu.get(), packet);
+          } else if (frame.layers.count != 0) {
+            now_sec = packet.sec;
+            process(frame.layers, packet, frame.digest);
+          }
+
+          if (frame.pdu != nullptr && !leasing) {
+            garbage.push(std::move(frame.pdu));
+            ++handed_back;
+          }
+          frame.pdu = nullptr;
+        }
       }
 
+      if (wall_sec != report_sec) {
+        auto total_malformed = malformed();
+        Log::debug("Queue %u: %zu PDUs freed by capture thread, %zu malformed"
+            " packets per second\n", id,
+            (handed_back - reported) / (wall_sec - report_sec),
+            (total_malformed - reported_malformed) / (wall_sec - report_sec));
+        reported = handed_back;
+        reported_malformed = total_malformed;
+        report_sec = wall_sec;
+      }
+
+      if (wall_sec - errors_sec >= ERROR_REPORT_INTERVAL) {
+        report_errors(id, errors, reported_errors, wall_sec - errors_sec);
+        errors_sec = wall_sec;
+      }
+
+      /* Release leases in batches, but never hold them while idle */
+      if (releases.size() >= CAPTURE_BATCH || leased.empty())
+        release();
+
       /* Perform idle check. Check the whole cache each second */
       check_idle_timeout(now_sec,
           (delta / 1000.f) * _cache.size());
@@ -266,6 +794,22 @@ Processor::start()
 
   /* Join the thread that handles packet capture */
   capture_thread.join();
+
+  /* Give back leases of packets that were not processed */
+  while (!leased.empty())
+    releases.push_back(leased.pop().handle);
+  release();
+
+  Log::info("Queue %u: %zu PDUs freed by capture thread\n", id, handed_back);
+
+  for (auto i = std::size_t{1}; i < errors.size(); ++i) {
+    auto count = errors[i].load(std::memory_order_relaxed);
+    if (count == 0)
+      continue;
+
+    Log::info("Queue %u: %zu packets with %s\n", id, count,
+        Parser::error_name(static_cast<Parser::Error>(i)));
+  }
 }
 
 } // namespace Flow
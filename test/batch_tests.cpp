@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <batch.hpp>
+
+using Bytes = std::vector<std::uint8_t>;
+
+/* Destination ports no UDP payload parser is registered for */
+static constexpr std::uint16_t PORTS[] = {53, 80, 123, 443, 5353};
+
+/**
+ * Ethernet frame with optional 802.1Q tag, IPv4 and TCP or UDP, with
+ * header fields randomized so that some of them are invalid.
+ */
+static Bytes
+random_packet(std::mt19937& random)
+{
+  auto pick = [&random](std::uint32_t bound) {
+    return std::uniform_int_distribution<std::uint32_t>{0, bound - 1}(random);
+  };
+
+  auto packet = Bytes(12, 0xaa);
+  if (pick(4) == 0)
+    packet.insert(packet.end(), {0x81, 0x00, std::uint8_t(pick(16)), 0x2a});
+  packet.insert(packet.end(), {0x08, 0x00});
+
+  const auto tcp = pick(2) == 0;
+  const std::uint8_t ihl = pick(8) == 0 ? pick(16) : 5 + pick(3);
+  const std::uint8_t version = pick(16) == 0 ? pick(16) : 4;
+  const std::uint8_t fragment = pick(8) == 0 ? pick(256) : 0x40;
+  packet.insert(packet.end(), {std::uint8_t(version << 4 | ihl), 0, 0, 0,
+      0, 0, fragment, 0, 64, std::uint8_t(tcp ? 6 : 17), 0, 0});
+  for (auto i = 0; i < 8; ++i)
+    packet.push_back(pick(256));
+  for (auto i = 5; i < ihl; ++i)
+    packet.insert(packet.end(), {1, 1, 1, 1});
+
+  const auto dport = PORTS[pick(sizeof(PORTS) / sizeof(PORTS[0]))];
+  packet.insert(packet.end(), {std::uint8_t(pick(256)), std::uint8_t(pick(256)),
+      std::uint8_t(dport >> 8), std::uint8_t(dport & 0xff)});
+  if (tcp) {
+    const std::uint8_t offset = pick(8) == 0 ? pick(16) : 5 + pick(3);
+    packet.insert(packet.end(), {0, 0, 0, 1, 0, 0, 0, 0,
+        std::uint8_t(offset << 4), 0x10, 0xff, 0xff, 0, 0, 0, 0});
+    for (auto i = 5; i < offset; ++i)
+      packet.insert(packet.end(), {1, 1, 1, 1});
+  } else {
+    packet.insert(packet.end(), {0, 8, 0, 0});
+  }
+
+  for (auto i = pick(32); i > 0; --i)
+    packet.push_back(pick(256));
+
+  /* Some packets are captured only partially */
+  if (pick(4) == 0)
+    packet.resize(pick(packet.size()));
+
+  return packet;
+}
+
+class BatchTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    Parser::require_layers([](Tins::PDU::PDUType) { return true; });
+
+    std::mt19937 random{42};
+    for (auto& packet : _data)
+      packet = random_packet(random);
+  }
+
+  /* Extracts every batch of random packets and calls check(packet, i) for
+   * every packet of the batch */
+  template<typename Extract, typename Check>
+  void extract_all(Extract extract, Check check) {
+    Packet packets[Parser::Columns::WIDTH];
+    for (std::size_t first = 0; first < COUNT;
+        first += Parser::Columns::WIDTH) {
+      for (std::size_t i = 0; i < Parser::Columns::WIDTH; ++i) {
+        const auto& data = _data[first + i];
+        packets[i] = Packet{};
+        packets[i].data = data.data();
+        packets[i].len = data.size();
+        packets[i].caplen = data.size();
+      }
+
+      auto columns = Parser::Columns{};
+      extract(packets, Parser::Columns::WIDTH, columns);
+      for (std::size_t i = 0; i < Parser::Columns::WIDTH; ++i)
+        check(columns, i, _data[first + i]);
+    }
+  }
+
+  static constexpr std::size_t COUNT = 4096;
+  Bytes _data[COUNT];
+};
+
+TEST_F(BatchTest, SimplePacketsParseTheSame) {
+  auto simple = 0;
+
+  extract_all(Parser::extract, [&simple](const Parser::Columns& columns,
+        std::size_t i, const Bytes& data) {
+    if (!columns.simple[i])
+      return;
+    ++simple;
+
+    auto parsed = Parser::Layers{};
+    ASSERT_EQ(Parser::parse(data.data(), data.size(), parsed),
+        Parser::Error::NONE);
+
+    auto filled = Parser::Layers{};
+    Parser::fill(columns, i, data.data(), filled);
+    ASSERT_EQ(filled.count, parsed.count);
+    for (std::size_t layer = 0; layer < parsed.count; ++layer) {
+      ASSERT_EQ(filled.layers[layer].type, parsed.layers[layer].type);
+      ASSERT_EQ(filled.layers[layer].offset, parsed.layers[layer].offset);
+      ASSERT_EQ(filled.layers[layer].size, parsed.layers[layer].size);
+    }
+
+    const auto* ip = data.data() + columns.network[i];
+    const auto* ports = data.data() + columns.transport[i];
+    std::uint32_t src, dst;
+    std::memcpy(&src, ip + 12, sizeof(src));
+    std::memcpy(&dst, ip + 16, sizeof(dst));
+    ASSERT_EQ(columns.digest[i], Parser::digest(src, dst, ip[9],
+          ports[0] << 8 | ports[1], ports[2] << 8 | ports[3]));
+    ASSERT_NE(columns.digest[i], 0);
+  });
+
+  /* Random packets are mostly valid */
+  ASSERT_GT(simple, int(COUNT / 4));
+}
+
+TEST_F(BatchTest, MalformedPacketsNeverSimple) {
+  extract_all(Parser::extract, [](const Parser::Columns& columns,
+        std::size_t i, const Bytes& data) {
+    auto layers = Parser::Layers{};
+    if (Parser::parse(data.data(), data.size(), layers)
+        != Parser::Error::NONE) {
+      ASSERT_FALSE(columns.simple[i]);
+    }
+  });
+}
+
+TEST_F(BatchTest, SameColumnsAsScalar) {
+  /* extract() uses AVX2 where CPU has it, otherwise this compares scalar
+   * code with itself */
+  std::vector<Parser::Columns> scalar;
+  extract_all(Parser::extract_scalar, [&scalar](
+        const Parser::Columns& columns, std::size_t i, const Bytes&) {
+    if (i == 0)
+      scalar.push_back(columns);
+  });
+
+  auto batch = std::size_t{0};
+  extract_all(Parser::extract, [&scalar, &batch](
+        const Parser::Columns& columns, std::size_t i, const Bytes&) {
+    const auto& expected = scalar[batch];
+    if (i == Parser::Columns::WIDTH - 1)
+      ++batch;
+
+    ASSERT_EQ(columns.simple[i], expected.simple[i]);
+    if (!columns.simple[i])
+      return;
+
+    ASSERT_EQ(columns.ethertype[i], expected.ethertype[i]);
+    ASSERT_EQ(columns.vlan[i], expected.vlan[i]);
+    ASSERT_EQ(columns.src[i], expected.src[i]);
+    ASSERT_EQ(columns.dst[i], expected.dst[i]);
+    ASSERT_EQ(columns.protocol[i], expected.protocol[i]);
+    ASSERT_EQ(columns.sport[i], expected.sport[i]);
+    ASSERT_EQ(columns.dport[i], expected.dport[i]);
+    ASSERT_EQ(columns.network[i], expected.network[i]);
+    ASSERT_EQ(columns.transport[i], expected.transport[i]);
+    ASSERT_EQ(columns.transport_size[i], expected.transport_size[i]);
+    ASSERT_EQ(columns.digest[i], expected.digest[i]);
+  });
+}
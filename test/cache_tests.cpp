@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include <cache.hpp>
+
+static Buffer
+key(std::uint32_t value)
+{
+  auto buffer = Buffer{};
+  buffer.push_back_any<std::uint32_t>(value);
+  return buffer;
+}
+
+TEST(Cache, FindsRecordByHashAndKey) {
+  auto cache = Flow::Cache{};
+  auto ts = timeval{1, 0};
+
+  cache.insert_record(7, ts, 0, 1, 100, key(1));
+
+  ASSERT_NE(cache.find_record(7, 0, key(1)), cache.end());
+  ASSERT_EQ(cache.find_record(8, 0, key(1)), cache.end());
+  ASSERT_EQ(cache.find_record(7, 0, key(2)), cache.end());
+}
+
+TEST(Cache, SameHashDifferentKeys) {
+  auto cache = Flow::Cache{};
+  auto ts = timeval{1, 0};
+
+  /* Keys colliding in hash are kept as separate flows */
+  cache.insert_record(7, ts, 0, 1, 100, key(1));
+  cache.insert_record(7, ts, 0, 2, 200, key(2));
+
+  ASSERT_EQ(cache.size(), 2);
+  ASSERT_EQ(cache.find_record(7, 0, key(1))->second.props.count, 1);
+  ASSERT_EQ(cache.find_record(7, 0, key(2))->second.props.count, 2);
+}
+
+TEST(Cache, InterfacesKeptApart) {
+  auto cache = Flow::Cache{};
+  auto ts = timeval{1, 0};
+
+  cache.insert_record(7, ts, 1, 1, 100, key(1));
+  cache.insert_record(7, ts, 2, 1, 100, key(1));
+
+  ASSERT_EQ(cache.size(), 2);
+  ASSERT_EQ(cache.find_record(7, 1, key(1))->second.props.interface, 1);
+  ASSERT_EQ(cache.find_record(7, 2, key(1))->second.props.interface, 2);
+  ASSERT_EQ(cache.find_record(7, 3, key(1)), cache.end());
+}
+
+TEST(Cache, InsertUpdatesExistingRecord) {
+  auto cache = Flow::Cache{};
+
+  cache.insert_record(7, timeval{2, 0}, 0, 1, 100, key(1));
+  auto it = cache.insert_record(7, timeval{3, 5}, 0, 2, 50, key(1));
+
+  ASSERT_EQ(cache.size(), 1);
+  ASSERT_EQ(it->second.props.count, 3);
+  ASSERT_EQ(it->second.props.octets, 150);
+  ASSERT_EQ(it->second.props.flow_start.tv_sec, 2);
+  ASSERT_EQ(it->second.props.flow_end.tv_sec, 3);
+  ASSERT_EQ(it->second.props.flow_end.tv_usec, 5);
+}
+
+TEST(Cache, UpdateKeepsFlowBounds) {
+  auto cache = Flow::Cache{};
+
+  auto it = cache.insert_record(7, timeval{5, 0}, 0, 1, 100, key(1));
+
+  /* Out of order packet moves only the start */
+  cache.update_record(it, timeval{4, 999999}, 1, 10);
+  ASSERT_EQ(it->second.props.flow_start.tv_sec, 4);
+  ASSERT_EQ(it->second.props.flow_end.tv_sec, 5);
+
+  cache.update_record(it, timeval{6, 1}, 1, 10);
+  ASSERT_EQ(it->second.props.flow_start.tv_sec, 4);
+  ASSERT_EQ(it->second.props.flow_end.tv_sec, 6);
+  ASSERT_EQ(it->second.props.count, 3);
+  ASSERT_EQ(it->second.props.octets, 120);
+}
@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <exporter.hpp>
+
+using Bytes = std::vector<std::uint8_t>;
+
+/* Size of message and set headers */
+static constexpr std::size_t MESSAGE_HEADER = 16;
+static constexpr std::size_t SET_HEADER = 4;
+
+static std::uint16_t
+read16(const Bytes& data, std::size_t offset)
+{
+  return data.at(offset) << 8 | data.at(offset + 1);
+}
+
+static std::uint32_t
+read32(const Bytes& data, std::size_t offset)
+{
+  return std::uint32_t(read16(data, offset)) << 16 | read16(data, offset + 2);
+}
+
+static std::uint64_t
+read64(const Bytes& data, std::size_t offset)
+{
+  return std::uint64_t(read32(data, offset)) << 32 | read32(data, offset + 4);
+}
+
+/**
+ * Collector accepting exporter's connection on loopback and reading whole
+ * IPFIX messages.
+ */
+class ExporterTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    _listener = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(_listener, 0);
+
+    auto address = sockaddr_in{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    auto size = socklen_t{sizeof(address)};
+    ASSERT_EQ(bind(_listener, reinterpret_cast<sockaddr*>(&address), size), 0);
+    ASSERT_EQ(listen(_listener, 1), 0);
+    ASSERT_EQ(getsockname(_listener, reinterpret_cast<sockaddr*>(&address),
+          &size), 0);
+    _port = ntohs(address.sin_port);
+  }
+
+  void TearDown() override {
+    if (_collector >= 0)
+      close(_collector);
+    close(_listener);
+  }
+
+  Flow::Exporter connect() {
+    auto exporter = Flow::Exporter{"127.0.0.1", _port};
+    _collector = accept(_listener, nullptr, nullptr);
+    return exporter;
+  }
+
+  Bytes receive() {
+    auto message = Bytes(MESSAGE_HEADER);
+    read(message.data(), MESSAGE_HEADER);
+    message.resize(read16(message, 2));
+    read(message.data() + MESSAGE_HEADER, message.size() - MESSAGE_HEADER);
+    return message;
+  }
+
+  int _listener = -1;
+  int _collector = -1;
+  std::uint16_t _port = 0;
+
+private:
+  void read(std::uint8_t* data, std::size_t size) {
+    while (size > 0) {
+      auto n = recv(_collector, data, size, 0);
+      ASSERT_GT(n, 0);
+      data += n;
+      size -= n;
+    }
+  }
+};
+
+/* Template of flow properties is the first set of every first message */
+struct FlowTemplate {
+  std::vector<std::pair<std::uint16_t, std::uint16_t>> fields;
+  std::size_t end;
+
+  explicit FlowTemplate(const Bytes& message)
+  {
+    auto set = MESSAGE_HEADER;
+    EXPECT_EQ(read16(message, set), IPFIX::SET_TEMPLATE);
+    EXPECT_EQ(read16(message, set + 4), IPFIX::SET_USER_TEMPLATE);
+
+    auto count = read16(message, set + 6);
+    for (std::size_t i = 0; i < count; ++i) {
+      auto field = set + SET_HEADER + 4 + i * 4;
+      fields.emplace_back(read16(message, field), read16(message, field + 2));
+    }
+    end = set + read16(message, set + 2);
+  }
+
+  /* Size of fixed length values, all but the trailing list */
+  std::size_t fixed_size() const {
+    auto size = std::size_t{0};
+    for (auto [id, length] : fields) {
+      if (length != IPFIX::TYPE_LIST)
+        size += length;
+    }
+    return size;
+  }
+
+  bool has(std::uint16_t id) const {
+    for (auto field : fields) {
+      if (field.first == id)
+        return true;
+    }
+    return false;
+  }
+};
+
+TEST_F(ExporterTest, TemplateWithoutInterface) {
+  auto exporter = connect();
+  exporter.flush();
+
+  auto message = receive();
+  ASSERT_EQ(read16(message, 0), IPFIX::VERSION);
+
+  auto flow = FlowTemplate{message};
+  ASSERT_EQ(flow.end, message.size());
+  ASSERT_FALSE(flow.has(IPFIX::FIELD_INGRESS_INTERFACE));
+  ASSERT_EQ(flow.fields.back().first, IPFIX::FIELD_SUB_TEMPLATE_MULTI_LIST);
+}
+
+TEST_F(ExporterTest, RecordMatchesTemplate) {
+  for (auto interfaces : {false, true}) {
+    auto exporter = connect();
+    exporter.set_interfaces(interfaces);
+
+    auto props = IPFIX::Properties{3, 150, timeval{2, 500000}, timeval{3, 0},
+      7};
+    auto values = Buffer{};
+    values.push_back_any<std::uint8_t>(0xff);
+    exporter.insert_record(props, IPFIX::REASON_IDLE, values);
+    exporter.flush();
+
+    auto message = receive();
+    auto flow = FlowTemplate{message};
+    ASSERT_EQ(flow.has(IPFIX::FIELD_INGRESS_INTERFACE), interfaces);
+
+    /* Record holds values of every fixed field, then the list */
+    auto record = flow.end;
+    ASSERT_EQ(read16(message, record), IPFIX::SET_USER_TEMPLATE);
+    ASSERT_EQ(read16(message, record + 2),
+        SET_HEADER + flow.fixed_size() + values.size());
+    ASSERT_EQ(record + read16(message, record + 2), message.size());
+
+    auto value = record + SET_HEADER;
+    for (auto [id, length] : flow.fields) {
+      switch (id) {
+      case IPFIX::FIELD_PACKET_DELTA_COUNT:
+        ASSERT_EQ(read64(message, value), 3);
+        break;
+      case IPFIX::FIELD_LAYER2_OCTET_DELTA_COUNT:
+        ASSERT_EQ(read64(message, value), 150);
+        break;
+      case IPFIX::FIELD_FLOW_START_MILLISECONDS:
+        ASSERT_EQ(read64(message, value), 2500);
+        break;
+      case IPFIX::FIELD_FLOW_END_REASON:
+        ASSERT_EQ(message.at(value), IPFIX::REASON_IDLE);
+        break;
+      case IPFIX::FIELD_INGRESS_INTERFACE:
+        ASSERT_EQ(read32(message, value), 7);
+        break;
+      case IPFIX::FIELD_SUB_TEMPLATE_MULTI_LIST:
+        ASSERT_EQ(message.at(value), 0xff);
+        break;
+      }
+      value += length == IPFIX::TYPE_LIST ? 0 : length;
+    }
+
+    close(_collector);
+    _collector = -1;
+  }
+}
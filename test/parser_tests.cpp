@@ -0,0 +1,437 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <parser.hpp>
+#include <protocols/geneve.hpp>
+#include <protocols/gre.hpp>
+#include <protocols/gtp.hpp>
+#include <protocols/vxlan.hpp>
+
+using Bytes = std::vector<std::uint8_t>;
+
+static void
+ethernet(Bytes& packet, std::uint16_t ethertype)
+{
+  for (auto i = 0; i < 12; ++i)
+    packet.push_back(i + 1);
+  packet.push_back(ethertype >> 8);
+  packet.push_back(ethertype & 0xff);
+}
+
+static void
+vlan(Bytes& packet, std::uint16_t id, std::uint16_t ethertype)
+{
+  packet.insert(packet.end(), {std::uint8_t(id >> 8), std::uint8_t(id & 0xff),
+      std::uint8_t(ethertype >> 8), std::uint8_t(ethertype & 0xff)});
+}
+
+static void
+ipv4(Bytes& packet, std::uint8_t protocol, std::uint8_t ihl = 5,
+    std::uint16_t fragment = 0)
+{
+  packet.insert(packet.end(), {
+      std::uint8_t(0x40 | ihl), 0, 0, 0, 0, 0,
+      std::uint8_t(fragment >> 8), std::uint8_t(fragment & 0xff),
+      64, protocol, 0, 0, 10, 0, 0, 1, 10, 0, 0, 2});
+  for (auto i = 5; i < ihl; ++i)
+    packet.insert(packet.end(), {1, 1, 1, 1});
+}
+
+static void
+ipv6(Bytes& packet, std::uint8_t next_header)
+{
+  packet.insert(packet.end(), {0x60, 0, 0, 0, 0, 0, next_header, 64});
+  for (auto i = 0; i < 32; ++i)
+    packet.push_back(i);
+}
+
+static void
+tcp(Bytes& packet, std::uint8_t offset = 5)
+{
+  packet.insert(packet.end(), {0x04, 0xd2, 0x00, 0x50, 0, 0, 0, 1, 0, 0, 0, 0,
+      std::uint8_t(offset << 4), 0x02, 0xff, 0xff, 0, 0, 0, 0});
+  for (auto i = 5; i < offset; ++i)
+    packet.insert(packet.end(), {1, 1, 1, 1});
+}
+
+static void
+udp(Bytes& packet, std::uint16_t dport)
+{
+  packet.insert(packet.end(), {0x30, 0x39,
+      std::uint8_t(dport >> 8), std::uint8_t(dport & 0xff), 0, 8, 0, 0});
+}
+
+static void
+payload(Bytes& packet, std::size_t size)
+{
+  for (std::size_t i = 0; i < size; ++i)
+    packet.push_back(i);
+}
+
+class ParserTest : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    Parser::register_tins_parser<Tins::IP, Protocols::GREPDU>(47);
+    Parser::register_tins_parser<Tins::IPv6, Protocols::GREPDU>(47);
+    Parser::register_udp_parser<Protocols::VXLANPDU>(
+        Protocols::VXLANPDU::VXLAN_PORT);
+    Parser::register_udp_parser<Protocols::GENEVEPDU>(
+        Protocols::GENEVEPDU::GENEVE_PORT);
+    Parser::register_udp_parser<Protocols::GTPPDU>(
+        Protocols::GTPPDU::GTP_PORT);
+  }
+
+  void SetUp() override {
+    /* Parser state is global, every test starts parsing whole packets */
+    Parser::require_layers([](Tins::PDU::PDUType) { return true; });
+  }
+
+  static Parser::Error parse(const Bytes& packet, Parser::Layers& layers) {
+    return Parser::parse(packet.data(), packet.size(), layers);
+  }
+};
+
+TEST_F(ParserTest, EthernetIPv4TCP) {
+  auto packet = Bytes{};
+  ethernet(packet, 0x0800);
+  ipv4(packet, 6);
+  tcp(packet);
+  payload(packet, 10);
+
+  auto layers = Parser::Layers{};
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.count, 3);
+  ASSERT_EQ(layers.layers[0].type, Tins::PDU::PDUType::ETHERNET_II);
+  ASSERT_EQ(layers.layers[1].type, Tins::PDU::PDUType::IP);
+  ASSERT_EQ(layers.layers[1].offset, 14);
+  ASSERT_EQ(layers.layers[1].size, 20);
+  ASSERT_EQ(layers.layers[2].type, Tins::PDU::PDUType::TCP);
+  ASSERT_EQ(layers.layers[2].offset, 34);
+  ASSERT_EQ(layers.layers[2].size, 20);
+
+  /* Headers are copied, payload is not */
+  for (auto i = 0u; i < 54; ++i)
+    ASSERT_EQ(layers.headers[i], packet[i]);
+}
+
+TEST_F(ParserTest, OptionsExtendHeaders) {
+  auto packet = Bytes{};
+  ethernet(packet, 0x0800);
+  ipv4(packet, 6, 7);
+  tcp(packet, 8);
+
+  auto layers = Parser::Layers{};
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.count, 3);
+  ASSERT_EQ(layers.layers[1].size, 28);
+  ASSERT_EQ(layers.layers[2].offset, 42);
+  ASSERT_EQ(layers.layers[2].size, 32);
+}
+
+TEST_F(ParserTest, VlanIPv4UDP) {
+  auto packet = Bytes{};
+  ethernet(packet, 0x8100);
+  vlan(packet, 5, 0x0800);
+  ipv4(packet, 17);
+  udp(packet, 53);
+
+  auto layers = Parser::Layers{};
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.count, 4);
+  ASSERT_EQ(layers.layers[1].type, Tins::PDU::PDUType::DOT1Q);
+  ASSERT_EQ(layers.layers[2].type, Tins::PDU::PDUType::IP);
+  ASSERT_EQ(layers.layers[2].offset, 18);
+  ASSERT_EQ(layers.layers[3].type, Tins::PDU::PDUType::UDP);
+  ASSERT_EQ(layers.layers[3].size, 8);
+}
+
+TEST_F(ParserTest, IPv6TCP) {
+  auto packet = Bytes{};
+  ethernet(packet, 0x86dd);
+  ipv6(packet, 6);
+  tcp(packet);
+
+  auto layers = Parser::Layers{};
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.count, 3);
+  ASSERT_EQ(layers.layers[1].type, Tins::PDU::PDUType::IPv6);
+  ASSERT_EQ(layers.layers[1].size, 40);
+  ASSERT_EQ(layers.layers[2].type, Tins::PDU::PDUType::TCP);
+  ASSERT_EQ(layers.layers[2].offset, 54);
+}
+
+TEST_F(ParserTest, MPLSStack) {
+  auto packet = Bytes{};
+  ethernet(packet, 0x8847);
+  packet.insert(packet.end(), {0, 1, 0, 64, 0, 2, 1, 64});
+  ipv4(packet, 17);
+  udp(packet, 53);
+
+  auto layers = Parser::Layers{};
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.count, 5);
+  ASSERT_EQ(layers.layers[1].type, Tins::PDU::PDUType::MPLS);
+  ASSERT_EQ(layers.layers[2].type, Tins::PDU::PDUType::MPLS);
+  ASSERT_EQ(layers.layers[3].type, Tins::PDU::PDUType::IP);
+  ASSERT_EQ(layers.layers[3].offset, 22);
+}
+
+TEST_F(ParserTest, FragmentHasNoTransport) {
+  auto packet = Bytes{};
+  ethernet(packet, 0x0800);
+  ipv4(packet, 6, 5, 0x2000);
+  payload(packet, 30);
+
+  auto layers = Parser::Layers{};
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.count, 2);
+  ASSERT_EQ(layers.layers[1].type, Tins::PDU::PDUType::IP);
+}
+
+TEST_F(ParserTest, UnknownEthertype) {
+  auto packet = Bytes{};
+  ethernet(packet, 0x0806);
+  payload(packet, 28);
+
+  auto layers = Parser::Layers{};
+  auto error = parse(packet, layers);
+  ASSERT_TRUE(Parser::parsed(error));
+  ASSERT_EQ(layers.count, 1);
+  ASSERT_EQ(layers.layers[0].type, Tins::PDU::PDUType::ETHERNET_II);
+}
+
+TEST_F(ParserTest, IPv6ExtensionUnsupported) {
+  auto packet = Bytes{};
+  ethernet(packet, 0x86dd);
+  ipv6(packet, 0);
+  payload(packet, 16);
+
+  auto layers = Parser::Layers{};
+  ASSERT_EQ(parse(packet, layers), Parser::Error::UNSUPPORTED);
+}
+
+TEST_F(ParserTest, MalformedHeaders) {
+  auto layers = Parser::Layers{};
+
+  auto short_ethernet = Bytes{1, 2, 3, 4, 5, 6};
+  ASSERT_EQ(parse(short_ethernet, layers), Parser::Error::TRUNCATED);
+
+  auto bad_ihl = Bytes{};
+  ethernet(bad_ihl, 0x0800);
+  ipv4(bad_ihl, 6, 4);
+  tcp(bad_ihl);
+  ASSERT_EQ(parse(bad_ihl, layers), Parser::Error::BAD_IHL);
+
+  auto long_ihl = Bytes{};
+  ethernet(long_ihl, 0x0800);
+  ipv4(long_ihl, 17);
+  long_ihl[14] = 0x4f;
+  ASSERT_EQ(parse(long_ihl, layers), Parser::Error::TRUNCATED);
+
+  auto bad_version = Bytes{};
+  ethernet(bad_version, 0x0800);
+  ipv4(bad_version, 6);
+  bad_version[14] = 0x65;
+  tcp(bad_version);
+  ASSERT_EQ(parse(bad_version, layers), Parser::Error::BAD_VERSION);
+
+  auto bad_offset = Bytes{};
+  ethernet(bad_offset, 0x0800);
+  ipv4(bad_offset, 6);
+  tcp(bad_offset, 4);
+  ASSERT_EQ(parse(bad_offset, layers), Parser::Error::BAD_TCP_OFFSET);
+
+  auto short_tcp = Bytes{};
+  ethernet(short_tcp, 0x0800);
+  ipv4(short_tcp, 6);
+  tcp(short_tcp);
+  short_tcp.resize(short_tcp.size() - 5);
+  ASSERT_EQ(parse(short_tcp, layers), Parser::Error::TRUNCATED);
+
+  auto short_options = Bytes{};
+  ethernet(short_options, 0x0800);
+  ipv4(short_options, 6);
+  tcp(short_options, 8);
+  short_options.resize(short_options.size() - 4);
+  ASSERT_EQ(parse(short_options, layers), Parser::Error::TRUNCATED);
+}
+
+TEST_F(ParserTest, StopsAtDeepestRequiredLayer) {
+  auto packet = Bytes{};
+  ethernet(packet, 0x8100);
+  vlan(packet, 5, 0x0800);
+  ipv4(packet, 6);
+  tcp(packet, 4);
+
+  /* Tags may be stacked, so header after VLAN is still read, but bad TCP
+   * header is never reached when only VLAN is keyed */
+  Parser::require_layers([](Tins::PDU::PDUType type) {
+    return type == Tins::PDU::PDUType::DOT1Q;
+  });
+
+  auto layers = Parser::Layers{};
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.count, 3);
+  ASSERT_EQ(layers.layers[1].type, Tins::PDU::PDUType::DOT1Q);
+  ASSERT_EQ(layers.layers[2].type, Tins::PDU::PDUType::IP);
+  ASSERT_FALSE(Parser::descends(Tins::PDU::PDUType::IP));
+}
+
+/* Fast path must find the same headers as libtins, as both feed one key */
+TEST_F(ParserTest, SameLayersAsLibtins) {
+  auto packets = std::vector<Bytes>{};
+
+  auto& v4 = packets.emplace_back();
+  ethernet(v4, 0x0800);
+  ipv4(v4, 6, 6);
+  tcp(v4, 7);
+  payload(v4, 20);
+
+  auto& tagged = packets.emplace_back();
+  ethernet(tagged, 0x8100);
+  vlan(tagged, 100, 0x0800);
+  ipv4(tagged, 17);
+  udp(tagged, 53);
+  payload(tagged, 12);
+
+  auto& v6 = packets.emplace_back();
+  ethernet(v6, 0x86dd);
+  ipv6(v6, 17);
+  udp(v6, 123);
+  payload(v6, 48);
+
+  /* GRE is decapsulated after IPv6 by both parsers */
+  auto& v6_gre = packets.emplace_back();
+  ethernet(v6_gre, 0x86dd);
+  ipv6(v6_gre, 47);
+  v6_gre.insert(v6_gre.end(), {0, 0, 0x08, 0x00});
+  ipv4(v6_gre, 6);
+  tcp(v6_gre);
+  payload(v6_gre, 16);
+
+  auto& fragment = packets.emplace_back();
+  ethernet(fragment, 0x0800);
+  ipv4(fragment, 6, 5, 0x2000);
+  payload(fragment, 24);
+
+  for (const auto& packet : packets) {
+    auto layers = Parser::Layers{};
+    ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+
+    auto pdu = Parser::parse(packet.data(), packet.size());
+    const auto* p = pdu.get();
+    for (auto i = 0u; i < layers.count; ++i, p = p->inner_pdu()) {
+      ASSERT_NE(p, nullptr);
+      ASSERT_EQ(layers.layers[i].type, p->pdu_type());
+      ASSERT_EQ(layers.layers[i].size, p->header_size());
+    }
+
+    /* Whatever libtins finds below is payload to fast path */
+    if (p != nullptr) {
+      ASSERT_EQ(p->pdu_type(), Tins::PDU::PDUType::RAW);
+    }
+  }
+}
+
+/* Layers needed by configuration of sections ip, udp and tcp, together
+ * with the given tunnel */
+static void
+require_tunnel(Tins::PDU::PDUType tunnel)
+{
+  Parser::require_layers([tunnel](Tins::PDU::PDUType type) {
+    return type == Tins::PDU::PDUType::IP || type == Tins::PDU::PDUType::UDP
+      || type == Tins::PDU::PDUType::TCP || type == tunnel;
+  });
+}
+
+static Bytes
+gtp_packet(std::uint8_t message_type)
+{
+  auto packet = Bytes{};
+  ethernet(packet, 0x0800);
+  ipv4(packet, 17);
+  udp(packet, Protocols::GTPPDU::GTP_PORT);
+  packet.insert(packet.end(), {0x30, message_type, 0, 28, 0, 0, 0, 9});
+  ipv4(packet, 17);
+  udp(packet, 53);
+  return packet;
+}
+
+TEST_F(ParserTest, GTPDecapsulatedOnlyWhenRequired) {
+  auto packet = gtp_packet(Protocols::GTPHeader::MESSAGE_G_PDU);
+  auto layers = Parser::Layers{};
+
+  /* Without [gtp] flows are keyed by the outer headers */
+  require_tunnel(Tins::PDU::PDUType::RAW);
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.count, 3);
+  ASSERT_EQ(layers.layers[2].type, Tins::PDU::PDUType::UDP);
+
+  require_tunnel(Protocols::GTPPDU_TYPE);
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.count, 6);
+  ASSERT_EQ(layers.layers[3].type, Protocols::GTPPDU_TYPE);
+  ASSERT_EQ(layers.layers[3].size, 8);
+  ASSERT_EQ(layers.layers[4].type, Tins::PDU::PDUType::IP);
+  ASSERT_EQ(layers.layers[5].type, Tins::PDU::PDUType::UDP);
+}
+
+TEST_F(ParserTest, GTPSignallingNotDecapsulated) {
+  /* Echo request carries no user data */
+  auto packet = gtp_packet(1);
+  auto layers = Parser::Layers{};
+
+  require_tunnel(Protocols::GTPPDU_TYPE);
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.count, 4);
+  ASSERT_EQ(layers.layers[3].type, Protocols::GTPPDU_TYPE);
+}
+
+TEST_F(ParserTest, VXLANDecapsulatedOnlyWhenRequired) {
+  auto packet = Bytes{};
+  ethernet(packet, 0x0800);
+  ipv4(packet, 17);
+  udp(packet, Protocols::VXLANPDU::VXLAN_PORT);
+  packet.insert(packet.end(), {0x08, 0, 0, 0, 0, 0, 42, 0});
+  ethernet(packet, 0x0800);
+  ipv4(packet, 6);
+  tcp(packet);
+
+  auto layers = Parser::Layers{};
+
+  require_tunnel(Tins::PDU::PDUType::RAW);
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.count, 3);
+
+  require_tunnel(Protocols::VXLANPDU_TYPE);
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.count, 7);
+  ASSERT_EQ(layers.layers[3].type, Protocols::VXLANPDU_TYPE);
+  ASSERT_EQ(layers.layers[4].type, Tins::PDU::PDUType::ETHERNET_II);
+  ASSERT_EQ(layers.layers[6].type, Tins::PDU::PDUType::TCP);
+  ASSERT_EQ(layers.layers[6].offset, 84);
+}
+
+TEST_F(ParserTest, GREDecapsulatedOnlyWhenRequired) {
+  auto packet = Bytes{};
+  ethernet(packet, 0x0800);
+  ipv4(packet, 47);
+  packet.insert(packet.end(), {0, 0, 0x08, 0x00});
+  ipv4(packet, 6);
+  tcp(packet);
+
+  auto layers = Parser::Layers{};
+
+  /* Tunnel header itself is read, but not what it carries */
+  require_tunnel(Tins::PDU::PDUType::RAW);
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.layers[layers.count - 1].type, Protocols::GREPDU_TYPE);
+
+  require_tunnel(Protocols::GREPDU_TYPE);
+  ASSERT_EQ(parse(packet, layers), Parser::Error::NONE);
+  ASSERT_EQ(layers.count, 5);
+  ASSERT_EQ(layers.layers[3].type, Tins::PDU::PDUType::IP);
+  ASSERT_EQ(layers.layers[4].type, Tins::PDU::PDUType::TCP);
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+
+#include <queue.hpp>
+
+TEST(Queue, KeepsOrderAcrossNodes) {
+  auto queue = Async::Queue<int, 4>{};
+
+  for (auto i = 0; i < 10; ++i)
+    queue.push(int{i});
+
+  for (auto i = 0; i < 10; ++i)
+    ASSERT_EQ(queue.pop(), i);
+
+  ASSERT_TRUE(queue.empty());
+}
+
+TEST(Queue, ReusesReadNodes) {
+  auto queue = Async::Queue<int, 4>{};
+
+  /* The first nodes are allocated, nothing is read yet */
+  for (auto i = 0; i < 12; ++i)
+    queue.push(int{i});
+  ASSERT_EQ(queue.reused(), 0);
+
+  for (auto i = 0; i < 12; ++i)
+    queue.pop();
+
+  /* Nodes read to the end are given to producer for the next ones */
+  for (auto i = 0; i < 8; ++i)
+    queue.push(int{i});
+  ASSERT_GT(queue.reused(), 0);
+
+  for (auto i = 0; i < 8; ++i)
+    ASSERT_EQ(queue.pop(), i);
+}
+
+/* Value counting its live instances, every node holds N of them */
+struct Counted {
+  static inline int live = 0;
+
+  Counted() { ++live; }
+  Counted(Counted&&) { ++live; }
+  Counted& operator=(Counted&&) = default;
+  ~Counted() { --live; }
+};
+
+TEST(Queue, FreesSurplusNodes) {
+  {
+    auto queue = Async::Queue<Counted, 4>{};
+
+    for (auto i = 0; i < 40; ++i)
+      queue.push(Counted{});
+    ASSERT_EQ(Counted::live, 10 * 4);
+
+    for (auto i = 0; i < 40; ++i)
+      queue.pop();
+
+    /* Producer keeps a few of the nodes read after burst, frees the rest */
+    for (auto i = 0; i < 8; ++i)
+      queue.push(Counted{});
+    ASSERT_LT(Counted::live, 10 * 4);
+
+    for (auto i = 0; i < 8; ++i)
+      queue.pop();
+  }
+
+  ASSERT_EQ(Counted::live, 0);
+}
+
+TEST(Queue, MovesValues) {
+  auto queue = Async::Queue<std::unique_ptr<int>, 2>{};
+
+  for (auto i = 0; i < 5; ++i)
+    queue.push(std::make_unique<int>(i));
+
+  for (auto i = 0; i < 5; ++i) {
+    auto value = queue.pop();
+    ASSERT_NE(value, nullptr);
+    ASSERT_EQ(*value, i);
+  }
+}
+
+TEST(Queue, ProducerAndConsumerThreads) {
+  constexpr auto count = 100000;
+  auto queue = Async::Queue<int, 16>{};
+
+  auto producer = std::thread([&queue]() {
+    for (auto i = 0; i < count; ++i) {
+      queue.push(int{i});
+      if (i % 64 == 0)
+        std::this_thread::yield();
+    }
+  });
+
+  auto expected = 0;
+  while (expected < count) {
+    if (queue.empty()) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    ASSERT_EQ(queue.pop(), expected);
+    ++expected;
+  }
+
+  producer.join();
+  ASSERT_TRUE(queue.empty());
+  ASSERT_GT(queue.reused(), 0);
+}
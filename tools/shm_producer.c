@@ -0,0 +1,127 @@
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <pcap.h>
+
+#include <shm_ring.h>
+
+/**
+ * Reference producer of ShmInput ring. Creates shared memory ring and
+ * writes packets of a pcap file into it. By default the producer waits
+ * for free slots, with -d it drops packets when the ring is full.
+ */
+
+#define DEFAULT_SLOT_COUNT 4096
+#define DEFAULT_SLOT_SIZE 2048
+
+static void
+usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-d] [-n SLOTS] [-s SLOT_SIZE] NAME FILE\n", name);
+  exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+  uint32_t slot_count = DEFAULT_SLOT_COUNT;
+  uint32_t slot_size = DEFAULT_SLOT_SIZE;
+  int drop = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "dn:s:")) != -1) {
+    switch (opt) {
+      case 'd':
+        drop = 1;
+        break;
+      case 'n':
+        slot_count = strtoul(optarg, NULL, 0);
+        break;
+      case 's':
+        slot_size = strtoul(optarg, NULL, 0);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if (argc - optind != 2 || !slot_count || slot_count & (slot_count - 1)
+      || slot_size % SHM_RING_ALIGN || slot_size <= sizeof(struct ShmSlot))
+    usage(argv[0]);
+
+  const char *name = argv[optind];
+  char errbuf[PCAP_ERRBUF_SIZE];
+  pcap_t *pcap = pcap_open_offline(argv[optind + 1], errbuf);
+  if (!pcap) {
+    fprintf(stderr, "%s\n", errbuf);
+    return EXIT_FAILURE;
+  }
+
+  uint64_t size = shm_ring_size(slot_count, slot_size);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 || ftruncate(fd, size)) {
+    perror(name);
+    return EXIT_FAILURE;
+  }
+
+  struct ShmRingHeader *ring = mmap(NULL, size, PROT_READ | PROT_WRITE,
+      MAP_SHARED, fd, 0);
+  close(fd);
+  if (ring == MAP_FAILED) {
+    perror("mmap");
+    shm_unlink(name);
+    return EXIT_FAILURE;
+  }
+
+  shm_ring_init(ring, slot_count, slot_size);
+
+  uint32_t room = slot_size - sizeof(struct ShmSlot);
+  unsigned long long written = 0;
+  struct pcap_pkthdr *header;
+  const u_char *data;
+
+  while (pcap_next_ex(pcap, &header, &data) == 1) {
+    struct ShmSlot *slot;
+
+    while (!(slot = shm_ring_reserve(ring))) {
+      if (drop)
+        break;
+      sched_yield();
+    }
+
+    if (!slot) {
+      __atomic_fetch_add(&ring->drops, 1, __ATOMIC_RELAXED);
+      continue;
+    }
+
+    slot->len = header->len;
+    slot->caplen = header->caplen < room ? header->caplen : room;
+    slot->sec = header->ts.tv_sec;
+    slot->usec = header->ts.tv_usec;
+    slot->interface = 0;
+    memcpy(shm_slot_data(slot), data, slot->caplen);
+
+    shm_ring_publish(slot);
+    ++written;
+  }
+
+  __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+  fprintf(stderr, "Written %llu packets, dropped %llu\n", written,
+      (unsigned long long)ring->drops);
+
+  /* Wait until consumer drains the ring, so that it can attach late */
+  while (__atomic_load_n(&ring->tail, __ATOMIC_RELAXED)
+      < __atomic_load_n(&ring->head, __ATOMIC_RELAXED))
+    usleep(1000);
+
+  munmap(ring, size);
+  shm_unlink(name);
+  pcap_close(pcap);
+
+  return EXIT_SUCCESS;
+}